@@ -0,0 +1,24 @@
+#pragma once
+#include "company.h"
+#include <QVector>
+#include <QString>
+
+// Компактный бинарный снимок базы (companies.bin).
+// Формат (little-endian):
+//   заголовок: магия "BSNP", версия, CRC-32 тела, размеры секций;
+//   таблица строк: смещения + UTF-8 байты имен компаний, маршрутов и городов;
+//   массивы компаний и маршрутов фиксированной длины (id, ссылки на строки);
+//   массив остановок фиксированной длины (id, город, длительность, цена);
+//   массив правил расписания (ссылки на строки с текстом правила);
+//   поток рейсов: время отправления в минутах и id каждого рейса в виде varint-дельт.
+class BinarySnapshot {
+public:
+    static constexpr quint32 FORMAT_VERSION = 4;
+
+    // Записывает снимок атомарно (через временный файл)
+    static void write(const QString& filePath, const QVector<Company>& companies);
+
+    // Читает снимок через отображение файла в память.
+    // Бросает DatabaseException, если файл поврежден или другой версии
+    static QVector<Company> read(const QString& filePath);
+};
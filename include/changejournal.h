@@ -0,0 +1,65 @@
+#pragma once
+#include "company.h"
+#include <QVector>
+#include <QString>
+#include <QDateTime>
+
+// Одна типизированная правка набора компаний.
+// Индексы указывают позиции на момент применения записи
+struct JournalEntry {
+    enum class Type : quint8 {
+        AddCompany,
+        RemoveCompany,
+        RenameCompany,
+        AddRoute,
+        RemoveRoute,
+        RenameRoute,
+        InsertStop,
+        RemoveStop,
+        AddTrip,
+        RemoveTrip,
+        InsertTripRule,
+        RemoveTripRule
+    };
+
+    Type type = Type::AddCompany;
+    quint32 id = 0;             // идентификатор добавляемой сущности
+    qint32 company = 0;
+    qint32 route = 0;
+    qint32 position = 0;
+    QString name;               // имя компании/маршрута, город остановки или текст правила расписания
+    qint32 durationMinutes = 0;
+    double price = 0;
+    QDateTime departure;
+};
+
+// Журнал правок (companies.journal), дописываемый вместо перезаписи companies.txt.
+// Заголовок хранит отпечаток базового файла: после его перезаписи старый журнал не применяется
+class ChangeJournal {
+public:
+    struct BaseStamp {
+        qint64 size = -1;
+        qint64 modifiedMsecs = 0;
+
+        bool operator==(const BaseStamp& other) const = default;
+    };
+
+    explicit ChangeJournal(const QString &filePath);
+
+    static BaseStamp stampOf(const QString &baseFilePath);
+
+    // Минимальный набор правок, превращающий before в after
+    static QVector<JournalEntry> diff(const QVector<Company>& before, const QVector<Company>& after);
+    static void apply(QVector<Company>& companies, const JournalEntry& entry);
+
+    bool matches(const BaseStamp& base) const;
+    // Есть ли записи поверх base; сами записи не разбираются
+    bool hasEntries(const BaseStamp& base) const;
+    QVector<JournalEntry> read(const BaseStamp& base) const;
+    void append(const QVector<JournalEntry>& entries) const;
+    void reset(const BaseStamp& base) const;
+    qint64 size() const;
+
+private:
+    QString m_filePath;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+// Плотный номер города в общем словаре
+using CityId = quint32;
+
+// Общий для процесса словарь названий городов.
+// Каждое название хранится один раз, остановки ссылаются на него по CityId.
+// Номера выдаются подряд с нуля и не переиспользуются; методы потокобезопасны
+class CityDictionary {
+public:
+    static constexpr CityId InvalidCityId = 0xFFFFFFFFu;
+
+    static CityDictionary& instance();
+
+    // Номер города, при необходимости добавляет его в словарь
+    CityId intern(const QString& name);
+
+    // Номер уже известного города или InvalidCityId
+    CityId find(const QString& name) const;
+
+    QString name(CityId id) const;
+    qsizetype size() const;
+
+    // Номера городов, в названии которых встречается text
+    QVector<CityId> findContaining(const QString& text, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+
+    CityDictionary(const CityDictionary&) = delete;
+    CityDictionary& operator=(const CityDictionary&) = delete;
+
+private:
+    CityDictionary() = default;
+
+    mutable QReadWriteLock m_lock;
+    QHash<QString, CityId> m_ids;
+    QVector<QString> m_names;
+};
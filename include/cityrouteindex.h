@@ -0,0 +1,80 @@
+#pragma once
+#include "company.h"
+#include "route.h"
+#include "citydictionary.h"
+#include <QHash>
+#include <QVector>
+#include <memory>
+
+// Инвертированный индекс "город -> маршруты с остановкой в нем".
+// Для каждого города хранится список (маршрут, номер остановки), упорядоченный по маршруту,
+// поэтому поиск пары городов - слияние двух коротких списков.
+// sync() приводит индекс к новой версии компаний: измененным считается маршрут с новым
+// Route::revision(), а списки остановок пересобираются, только если изменились его города.
+// sync() обходит все маршруты, поэтому вызывается при публикации новой версии данных,
+// а не перед каждым запросом (см. RouteFinder::setDatabase). Класс не потокобезопасен
+class CityRouteIndex {
+public:
+    struct Posting {
+        qint32 slot = -1;       // номер маршрута внутри индекса
+        qint32 position = -1;   // номер остановки в маршруте
+    };
+
+    CityRouteIndex() = default;
+    explicit CityRouteIndex(const QVector<Company>& companies);
+
+    // Возвращает true, если набор маршрутов, их порядок или данные изменились либо маршрут
+    // представлен другим объектом (например, после отделения компании)
+    bool sync(const QVector<Company>& companies);
+
+    // Маршруты, где from встречается раньше to, в порядке обхода компаний
+    QVector<std::shared_ptr<const Route>> routesBetween(CityId from, CityId to) const;
+    // То же в виде номеров маршрутов; found очищается и переиспользуется вызывающим как буфер
+    void slotsBetween(CityId from, CityId to, QVector<qint32>& found) const;
+    // Маршруты с номерами из found в порядке обхода компаний (found при этом сортируется)
+    QVector<std::shared_ptr<const Route>> routesOf(QVector<qint32>& found) const;
+    bool hasRouteBetween(CityId from, CityId to) const;
+
+    // Все остановки в городе, упорядоченные по номеру маршрута
+    const QVector<Posting>& postings(CityId city) const;
+    const std::shared_ptr<const Route>& route(qint32 slot) const { return m_slots[slot].route; }
+    // Верхняя граница номеров маршрутов (номера освободившихся мест переиспользуются)
+    qint32 slotCount() const { return static_cast<qint32>(m_slots.size()); }
+    qsizetype routeCount() const { return m_slots.size() - m_freeSlots.size(); }
+
+    // Номер последней синхронизации, а также города и маршруты, которые она изменила (по возрастанию).
+    // У освобожденного номера маршрута route(slot) пуст
+    quint64 syncNumber() const { return m_syncNumber; }
+    const QVector<CityId>& touchedCities() const { return m_touchedCities; }
+    const QVector<qint32>& touchedSlots() const { return m_touchedSlots; }
+
+private:
+    struct Slot {
+        std::shared_ptr<const Route> route;
+        QVector<CityId> cities;     // города, по которым построены списки (разделяются с маршрутом)
+        quint64 revision = 0;       // Route::revision() при последней синхронизации
+        quint32 id = 0;
+        qint64 order = 0;           // место маршрута при последнем обходе компаний
+        quint64 seen = 0;           // номер синхронизации, в которой маршрут встречался
+        bool used = false;
+    };
+
+    qint32 slotFor(const std::shared_ptr<const Route>& route);
+    void releaseSlot(qint32 slot);
+    void indexSlot(qint32 slot);
+    void unindexSlot(qint32 slot);
+
+    // Обходит маршруты, содержащие оба города, с первой остановкой в from и последней в to
+    template<typename Visit>
+    void forEachRouteBetween(CityId from, CityId to, Visit visit) const;
+
+    QVector<Slot> m_slots;
+    QVector<qint32> m_freeSlots;
+    // Маршруты с назначенным id узнаются по id, остальные - по адресу объекта
+    QHash<quint32, qint32> m_slotById;
+    QHash<const Route*, qint32> m_slotByRoute;
+    QHash<CityId, QVector<Posting>> m_postings;
+    QVector<CityId> m_touchedCities;
+    QVector<qint32> m_touchedSlots;
+    quint64 m_syncNumber = 0;
+};
@@ -1,31 +1,82 @@
 #pragma once
 #include <QVector>
 #include <QString>
+#include <QSharedDataPointer>
+#include <iterator>
 #include <memory>
 
-#include <QString>
-#include <memory>
-#include <utility>
-
 class Route;
+class CompanyData;
+
+// Маршруты константной компании. Указатели выдаются на константные маршруты: через копию
+// компании нельзя изменить маршрут, который разделяет другая копия. Список действителен,
+// пока компания жива и не изменяется
+class RouteList {
+public:
+    using Handles = QVector<std::shared_ptr<Route>>;
+
+    class const_iterator {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::shared_ptr<const Route>;
+        using difference_type = qsizetype;
+        using reference = std::shared_ptr<const Route>;
+
+        const_iterator() = default;
+        explicit const_iterator(Handles::const_iterator it) : m_it(it) {}
+
+        std::shared_ptr<const Route> operator*() const { return *m_it; }
+        const_iterator& operator++() {
+            ++m_it;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++m_it;
+            return previous;
+        }
+        bool operator==(const const_iterator& other) const { return m_it == other.m_it; }
 
+    private:
+        Handles::const_iterator m_it{};
+    };
+
+    explicit RouteList(const Handles& routes) : m_routes(&routes) {}
+
+    qsizetype size() const { return m_routes->size(); }
+    bool isEmpty() const { return m_routes->isEmpty(); }
+    std::shared_ptr<const Route> at(qsizetype position) const { return m_routes->at(position); }
+    std::shared_ptr<const Route> operator[](qsizetype position) const { return m_routes->at(position); }
+    const_iterator begin() const { return const_iterator(m_routes->cbegin()); }
+    const_iterator end() const { return const_iterator(m_routes->cend()); }
+
+private:
+    const Handles *m_routes;
+};
+
+// Компания с неявным разделением данных: копирование - O(1).
+// При первом изменении копии ее список маршрутов копируется поверхностно:
+// маршруты сами разделяют данные и копируются только при своем изменении.
+// Константная компания выдает только константные маршруты, изменять их можно через mutableRoutes()
 class Company {
 public:
     explicit Company(const QString &name = "");
     ~Company();
 
     Company(const Company& other);
-    Company(Company&& other) noexcept;
     Company& operator=(const Company& other);
-    Company& operator=(Company&& other) noexcept;
 
+    quint32 id() const;
+    void setId(quint32 id);
     QString name() const;
     void setName(const QString &name);
     void addRoute(std::shared_ptr<Route> route);
-    QVector<std::shared_ptr<Route>>& routes();
-    const QVector<std::shared_ptr<Route>>& routes() const;
+    RouteList routes() const;
+
+    // Отделяет компанию от общих данных; маршруты изменяются только через этот список
+    QVector<std::shared_ptr<Route>>& mutableRoutes();
 
 private:
-    QString m_name;
-    QVector<std::shared_ptr<Route>> m_routes;
+    QSharedDataPointer<CompanyData> d;
 };
@@ -0,0 +1,91 @@
+#pragma once
+#include "company.h"
+#include "journey.h"
+#include "citydictionary.h"
+#include <QVector>
+#include <limits>
+#include <memory>
+
+// Поиск самого раннего прибытия просмотром связей (Connection Scan).
+// Сеть разворачивается в один массив элементарных связей "город -> следующий город рейса",
+// упорядоченный по времени отправления; запрос - один линейный проход по его части.
+// В сеть попадают связи с отправлением в [fromMinutes, toMinutes), в том числе связи рейсов,
+// вышедших с первой остановки раньше fromMinutes; рейсы по правилам разворачиваются только на это окно.
+// Построенная сеть не меняется (маршруты копируются с разделением данных). Запросы используют
+// общий рабочий буфер, поэтому один объект не опрашивается из нескольких потоков одновременно
+class ConnectionScan {
+public:
+    static constexpr qint32 UNREACHED = std::numeric_limits<qint32>::max();
+
+    // Элементарная связь: рейс trip проезжает от остановки position до position + 1
+    struct Connection {
+        CityId from = CityDictionary::InvalidCityId;
+        CityId to = CityDictionary::InvalidCityId;
+        qint32 departure = 0;
+        qint32 arrival = 0;
+        qint32 trip = -1;
+        qint32 position = -1;
+    };
+
+    ConnectionScan() = default;
+    ConnectionScan(const QVector<Company>& companies, qint32 fromMinutes, qint32 toMinutes);
+
+    // Самое раннее прибытие в to при отправлении из from не раньше departAfter; пустая поездка - если недостижимо
+    Journey earliestArrival(CityId from, CityId to, qint32 departAfter, int minTransferMinutes = 0) const;
+
+    // Самые ранние прибытия во все города за один проход; индекс - CityId, UNREACHED - недостижим
+    QVector<qint32> earliestArrivals(CityId from, qint32 departAfter, int minTransferMinutes = 0) const;
+
+    // Профиль: все недоминируемые по (позже отправление, раньше прибытие) поездки из from в to
+    // с отправлением в [windowStart, windowEnd], по возрастанию отправления.
+    // Один обратный проход по связям, а не отдельный запрос на каждое отправление
+    QVector<Journey> profile(CityId from, CityId to, qint32 windowStart, qint32 windowEnd,
+                             int minTransferMinutes = 0) const;
+
+    const QVector<Connection>& connections() const { return m_connections; }
+    qint32 fromMinutes() const { return m_fromMinutes; }
+    qint32 toMinutes() const { return m_toMinutes; }
+    // Есть ли в сети все связи с отправлением в [fromMinutes, toMinutes)
+    bool covers(qint32 fromMinutes, qint32 toMinutes) const {
+        return fromMinutes >= m_fromMinutes && toMinutes <= m_toMinutes;
+    }
+
+private:
+    struct TripInfo {
+        qint32 route = -1;
+        qint32 departure = 0;
+        quint32 id = 0;
+    };
+
+    // Последний участок пути в город: связи посадки и высадки
+    struct Arrival {
+        qint32 boardConnection = -1;
+        qint32 alightConnection = -1;
+    };
+
+    // Вариант профиля: отправление enter, высадка с того же рейса на exit
+    struct ProfileEntry {
+        qint32 departure = 0;
+        qint32 arrival = UNREACHED;
+        qint32 enter = -1;
+        qint32 exit = -1;
+    };
+
+    static const ProfileEntry* entryAfter(const QVector<ProfileEntry> &entries, qint64 time);
+    JourneyLeg legOf(qint32 enter, qint32 exit) const;
+
+    // Общий проход; при target != InvalidCityId останавливается, когда target уже не улучшить
+    void scan(CityId from, CityId target, qint32 departAfter, int minTransferMinutes,
+              QVector<qint32> &arrivals, QVector<Arrival> *journeys) const;
+
+    QVector<std::shared_ptr<Route>> m_routes;
+    QVector<TripInfo> m_trips;
+    QVector<Connection> m_connections;
+    qint32 m_fromMinutes = 0;
+    qint32 m_toMinutes = 0;
+
+    // Для каждого рейса - связь, на которой на него сели (-1 - еще не сели); между запросами
+    // все элементы равны -1, сбрасываются только рейсы из m_boardedTrips
+    mutable QVector<qint32> m_boarded;
+    mutable QVector<qint32> m_boardedTrips;
+};
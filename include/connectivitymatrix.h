@@ -0,0 +1,37 @@
+#pragma once
+#include "cityrouteindex.h"
+#include "citydictionary.h"
+#include <QVector>
+
+// Матрица связности городов "город x город" в виде битовых строк по 64 города в слове.
+// Бит (from, to) прямой связи установлен, если есть маршрут с остановкой в from раньше, чем в to.
+// Замыкание на k пересадок строится пословным OR строк прямых связей и без учета расписания,
+// поэтому отсутствие бита означает, что поездки нет ни в какое время. Класс не потокобезопасен
+class ConnectivityMatrix {
+public:
+    // Приводит матрицу к индексу. Если с прошлого вызова индекс синхронизировался ровно один раз,
+    // пересчитываются только строки городов из index.touchedCities(), иначе матрица строится заново
+    void update(const CityRouteIndex& index);
+    void rebuild(const CityRouteIndex& index);
+
+    bool hasDirect(CityId from, CityId to) const;
+    // Есть ли путь не более чем с maxTransfers пересадками
+    bool isReachable(CityId from, CityId to, int maxTransfers) const;
+
+    qint32 cityCount() const { return m_cityCount; }
+
+private:
+    const quint64* directRow(CityId city) const { return m_direct.constData() + qsizetype(city) * m_stride; }
+    void resize(qint32 cityCount);
+    void updateRow(const CityRouteIndex& index, CityId city);
+    // Строки замыкания на transfers пересадок (transfers >= 1), при необходимости достраивает уровни
+    const QVector<quint64>& closure(int transfers) const;
+
+    qint32 m_cityCount = 0;
+    qint32 m_stride = 0;            // слов в строке
+    QVector<quint64> m_direct;
+    quint64 m_syncNumber = 0;
+    // m_closure[t - 1] - достижимость не более чем с t пересадками; сбрасывается при изменении строк
+    mutable QVector<QVector<quint64>> m_closure;
+    mutable bool m_closureComplete = false;     // последний уровень больше не растет
+};
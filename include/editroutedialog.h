@@ -23,14 +23,20 @@ private slots:
     void onEditTrip(int row);
     void onCopyTrip(int row);
     void onRemoveTrip(int row);
+    void onAddTripRule();
+    void onEditTripRule(int row);
+    void onRemoveTripRule(int row);
     void updateStopsTable();
     void updateTripsTable();
+    void updateTripRulesTable();
 
 private:
     Route &m_route;
     QLineEdit *leRouteName;
     QTableWidget *tableStops;
     QTableWidget *tableTrips;
+    QTableWidget *tableTripRules;
     QPushButton *btnAddStop;
     QPushButton *btnAddTrip;
+    QPushButton *btnAddTripRule;
 };
@@ -0,0 +1,38 @@
+#pragma once
+#include "company.h"
+#include <QHash>
+#include <QVector>
+
+// Положение сущности в списке компаний: индексы компании и маршрута,
+// item - номер остановки или рейса внутри маршрута
+struct EntityLocation {
+    qsizetype company = -1;
+    qsizetype route = -1;
+    qsizetype item = -1;
+
+    bool isValid() const { return company >= 0; }
+};
+
+// Таблицы "идентификатор -> положение" для одной версии данных.
+// Идентификаторы 32-битные и уникальны среди сущностей одного вида; 0 - не назначен
+class EntityIndex {
+public:
+    EntityIndex() = default;
+    explicit EntityIndex(const QVector<Company>& companies);
+
+    // Назначает идентификаторы новым сущностям и копиям с уже занятым id.
+    // Список изменяется (и отделяется от общих данных) только если это нужно.
+    // Возвращает true, если хотя бы один идентификатор был назначен
+    static bool assignIds(QVector<Company>& companies);
+
+    EntityLocation company(quint32 id) const;
+    EntityLocation route(quint32 id) const;
+    EntityLocation stop(quint32 id) const;
+    EntityLocation trip(quint32 id) const;
+
+private:
+    QHash<quint32, EntityLocation> m_companies;
+    QHash<quint32, EntityLocation> m_routes;
+    QHash<quint32, EntityLocation> m_stops;
+    QHash<quint32, EntityLocation> m_trips;
+};
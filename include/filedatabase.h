@@ -1,52 +1,139 @@
 #pragma once
 #include "company.h"
+#include "changejournal.h"
+#include "entityindex.h"
 #include "route.h"
 #include "trip.h"
+#include "triprule.h"
 #include "stop.h"
 #include <QVector>
 #include <QString>
 #include <QSet>
+#include <QByteArrayView>
 #include <QTimer>
+#include <QFutureWatcher>
 #include <QObject>
+#include <QFile>
+#include <functional>
 #include <memory>
 
 class FileDatabase : public QObject {
     Q_OBJECT
 
 public:
+    // Способ чтения companies.txt при загрузке
+    enum class LoadMode {
+        Buffered,       // файл читается целиком в буфер
+        MemoryMapped    // файл отображается в память без копирования
+    };
+
     explicit FileDatabase(const QString &folderPath, QObject *parent = nullptr);
+    ~FileDatabase() override;
 
     QVector<Company> loadCompanies() const;
+
+    // Текущая версия данных в памяти. Копия разделяется неявно и стоит O(1);
+    // читатели не изменяют ее, а писатели публикуют новую версию через setCompanies
+    QVector<Company> companies() const;
+    // Таблицы поиска по идентификатору для той же версии, что и companies()
+    EntityIndex index() const;
+    quint64 generation() const;
+
+    // Потоковый обход базы: данные передаются в колбэк по мере разбора файла,
+    // в памяти держится только текущая компания (маршрут, рейс), а не весь список.
+    // Если в журнале есть несохраненные в companies.txt правки, обходится собранный список
+    void forEachCompany(const std::function<void(const Company&)>& visit) const;
+    void forEachRoute(const std::function<void(const QString& companyName, const Route& route)>& visit) const;
+    // Рейсы с отправлением в [start, end). Маршрут в колбэке содержит только остановки,
+    // рейсы по нему не накапливаются; правила расписания разворачиваются только внутри окна
+    void forEachTrip(const QDateTime& start, const QDateTime& end,
+                     const std::function<void(const QString& companyName, const Route& route, const Trip& trip)>& visit) const;
+
+    // Получатель событий парсера (определен в filedatabase.cpp)
+    class ParseSink;
+
+    void setLoadMode(LoadMode mode);
+    LoadMode loadMode() const;
     void saveCompanies();
     void setCompanies(const QVector<Company> &companies);
 
     void scheduleAutoSave();
     void setAutoSaveEnabled(bool enabled);
+    void setJournalCompactionThreshold(qint64 bytes);
+
+signals:
+    // Фоновое автосохранение завершено; при ошибке errorMessage содержит причину
+    void autoSaveFinished(bool success, const QString &errorMessage);
+
+    // Опубликована новая версия данных (generation() увеличен)
+    void companiesChanged();
 
 private slots:
     void performAutoSave();
+    void onAutoSaveFinished();
 
 private:
+    // Неизменяемый снимок данных, который пишет фоновый поток
+    struct AutoSaveJob {
+        QVector<Company> companies;
+        QVector<JournalEntry> entries;
+        qint64 compactionThreshold = 0;
+        bool fullSave = false;
+    };
+
+    struct AutoSaveResult {
+        bool success = false;
+        QString errorMessage;
+    };
+
+    AutoSaveJob takeAutoSaveJob();
+    AutoSaveResult writeAutoSave(const AutoSaveJob &job) const;
+    void writeCompaniesFile(const QVector<Company> &companies) const;
+
     QString companiesFilePath() const;
+    QString snapshotFilePath() const;
+    QString journalFilePath() const;
+    QVector<Company> loadBaseCompanies() const;
+    QByteArrayView readCompaniesFile(QFile &file, LoadMode mode, QByteArray &buffer) const;
+    bool canStreamCompanies() const;
+    bool hasUnsavedChanges() const;
+    // Текущие данные для обхода, когда файл нельзя читать потоково
+    QVector<Company> visitedCompanies() const;
+    void streamCompanies(ParseSink &sink) const;
+    void replayJournal(QVector<Company> &companies) const;
+    bool isSnapshotFresh() const;
+    void writeSnapshot(const QVector<Company> &companies) const;
     void validateCompany(const Company& company, QSet<QString>& companyNames) const;
     void validateCompanies(const QVector<Company> &companies) const;
-    void validateStop(const std::shared_ptr<Stop>& stop) const;
-    void validateTrip(const std::shared_ptr<Trip>& trip, const QString& routeName) const;
-    void validateRoute(const std::shared_ptr<Route>& route, const QString& companyName, QList<QString>& routeNames) const;
+    void validateStop(const Route& route, int position) const;
+    void validateTrip(qint32 departureMinutes, const QString& routeName) const;
+    void validateRoute(const std::shared_ptr<const Route>& route, const QString& companyName, QList<QString>& routeNames) const;
 
     // Вспомогательные функции для loadCompanies
-    void processCompanySeparator(Company& currentCompany, std::shared_ptr<Route>& currentRoute, QVector<Company>& list) const;
-    void processCompanyLine(const QString& line, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute, QVector<Company>& list) const;
-    void processRouteLine(const QString& line, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute) const;
-    void processStopLine(const QString& line, int lineNumber, const std::shared_ptr<Route>& currentRoute) const;
-    void processTripLine(const QString& line, int lineNumber, const std::shared_ptr<Route>& currentRoute) const;
+    QVector<Company> parseCompanies(QByteArrayView data, int& lineNumber) const;
+    void parseCompanyBlock(QByteArrayView data, int& lineNumber, ParseSink& sink) const;
+    void processCompanySeparator(Company& currentCompany, std::shared_ptr<Route>& currentRoute, ParseSink& sink) const;
+    void processCompanyLine(QByteArrayView line, quint32 id, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute, ParseSink& sink) const;
+    void processRouteLine(QByteArrayView line, quint32 id, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute, ParseSink& sink) const;
+    void processStopLine(QByteArrayView line, quint32 id, int lineNumber, const std::shared_ptr<Route>& currentRoute) const;
+    void processTripLine(QByteArrayView line, quint32 id, int lineNumber, const Company& currentCompany, const std::shared_ptr<Route>& currentRoute, ParseSink& sink) const;
+    void processRuleLine(QByteArrayView line, int lineNumber, const Company& currentCompany, const std::shared_ptr<Route>& currentRoute, ParseSink& sink) const;
     
     // Вспомогательные функции для saveCompanies
     void saveCompany(const Company& company, QTextStream& out, bool isLast) const;
-    void saveRoute(const std::shared_ptr<Route>& route, QTextStream& out) const;
+    void saveRoute(const std::shared_ptr<const Route>& route, QTextStream& out) const;
 
     QString m_folderPath;
+    ChangeJournal m_journal;
+    QVector<JournalEntry> m_pendingEntries;
+    qint64 m_journalCompactionThreshold = 4 * 1024 * 1024;
     QVector<Company> m_companies;
+    EntityIndex m_index;
+    quint64 m_generation = 0;
     QTimer *m_autoSaveTimer;
+    QFutureWatcher<AutoSaveResult> *m_autoSaveWatcher;
     bool m_autoSaveEnabled = true;
+    bool m_autoSaveRequested = false;   // пришли правки, пока шла запись
+    bool m_fullSaveRequired = false;    // прошлая запись не удалась - журналу верить нельзя
+    LoadMode m_loadMode = LoadMode::MemoryMapped;
 };
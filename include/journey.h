@@ -0,0 +1,57 @@
+#pragma once
+#include "route.h"
+#include "trip.h"
+#include "citydictionary.h"
+#include <QDateTime>
+#include <QVector>
+#include <limits>
+#include <memory>
+
+// Участок поездки: один рейс одного маршрута от остановки посадки до остановки высадки.
+// Времена - минуты, как в Trip
+struct JourneyLeg {
+    std::shared_ptr<const Route> route;
+    quint32 tripId = 0;                             // 0 - рейс по правилу расписания
+    qint32 tripDeparture = Trip::INVALID_MINUTES;   // отправление рейса с первой остановки маршрута
+    int boardStop = -1;
+    int alightStop = -1;
+    qint32 departure = Trip::INVALID_MINUTES;
+    qint32 arrival = Trip::INVALID_MINUTES;
+    double price = 0;
+
+    QDateTime departureTime() const { return Trip::toDateTime(departure); }
+    QDateTime arrivalTime() const { return Trip::toDateTime(arrival); }
+    QString fromCity() const { return route->stopCity(boardStop); }
+    QString toCity() const { return route->stopCity(alightStop); }
+};
+
+// Поездка из одного или нескольких участков с пересадками в городах между ними
+struct Journey {
+    QVector<JourneyLeg> legs;
+
+    bool isEmpty() const { return legs.isEmpty(); }
+    qint32 departure() const { return legs.first().departure; }
+    qint32 arrival() const { return legs.last().arrival; }
+    int durationMinutes() const { return arrival() - departure(); }
+    int transfers() const { return static_cast<int>(legs.size()) - 1; }
+
+    double price() const {
+        double total = 0;
+        for (const JourneyLeg &leg : legs) {
+            total += leg.price;
+        }
+        return total;
+    }
+};
+
+// Город, достижимый из заданного: лучшие значения каждого критерия по отдельности
+// (самое раннее прибытие и самая низкая стоимость могут давать разные поездки)
+struct ReachableCity {
+    CityId city = CityDictionary::InvalidCityId;
+    qint32 earliestArrival = std::numeric_limits<qint32>::max();
+    double lowestPrice = std::numeric_limits<double>::infinity();
+    int fewestTransfers = std::numeric_limits<int>::max();
+
+    QString name() const { return CityDictionary::instance().name(city); }
+    QDateTime arrivalTime() const { return Trip::toDateTime(earliestArrival); }
+};
@@ -6,6 +6,7 @@
 #include <QTimer>
 #include <QLineEdit>
 #include <QComboBox>
+#include <QSet>
 #include "filedatabase.h"
 #include "company.h"
 #include "route.h"
@@ -15,7 +16,7 @@ class MainMenu : public QMainWindow {
     Q_OBJECT
 
 public:
-    explicit MainMenu(QWidget *parent = nullptr);
+    explicit MainMenu(FileDatabase *database, QWidget *parent = nullptr);
 
 private slots:
     void refreshTrips();
@@ -28,11 +29,12 @@ private:
     void setupUI();
     void loadData();
     void updateFilters();
-    QDateTime getTripDeparture(const std::shared_ptr<Trip>& trip, const std::shared_ptr<Route>& route) const;
-    bool tripMatchesFilter(const std::shared_ptr<Trip>& trip, const std::shared_ptr<Route>& route, const QString& companyName) const;
+    bool routeMatchesFilter(const std::shared_ptr<const Route>& route, const QString& companyName) const;
 
     FileDatabase *db;
     QVector<Company> companies;
+    EntityIndex index;      // поиск по id в той же версии данных, что и companies
+    QSet<CityId> matchingCities;    // города под текущую строку поиска
 
     QTableWidget *tableTrips;
     QPushButton *btnManageRoutes;
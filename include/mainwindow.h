@@ -12,7 +12,7 @@ class QPushButton;
 class MainWindow : public QMainWindow {
     Q_OBJECT
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    explicit MainWindow(FileDatabase *database, QWidget *parent = nullptr);
 
 private slots:
     void onCompanyChanged(int index);
@@ -21,10 +21,10 @@ private slots:
     void onRemoveCompany();
     void onAddRoute();
 
-    void onEditRoute(int row);
-    void onCopyRoute(int row);
-    void onRemoveRoute(int row);
-    void onShowRouteDetails(int row);
+    void onEditRoute(quint32 routeId);
+    void onCopyRoute(quint32 routeId);
+    void onRemoveRoute(quint32 routeId);
+    void onShowRouteDetails(quint32 routeId);
 
     void onDataChanged();
 
@@ -32,6 +32,7 @@ private:
     void loadCompanies();
     void refreshCompanySelector();
     void refreshRoutesTable();
+    EntityLocation locateRoute(quint32 routeId) const;
 
     FileDatabase *db;
     QVector<Company> companies;
@@ -0,0 +1,73 @@
+#pragma once
+#include "cityrouteindex.h"
+#include "journey.h"
+#include "roundqueue.h"
+#include <QVector>
+#include <limits>
+
+// Многокритериальный поиск поездок (McRAPTOR): вместо одного лучшего прибытия в городе
+// хранится набор недоминируемых меток (прибытие, стоимость) на каждое число рейсов.
+// Метка отбрасывается, если ее не лучше по обоим критериям метка того же города
+// с не большим числом пересадок или уже найденная поездка в город назначения.
+// Объект хранит рабочие массивы между запросами и не используется из нескольких потоков
+class ParetoSearch {
+public:
+    struct Query {
+        CityId from = CityDictionary::InvalidCityId;
+        CityId to = CityDictionary::InvalidCityId;
+        qint32 departAfter = Trip::INVALID_MINUTES;
+        int maxTransfers = 2;
+        int minTransferMinutes = 10;
+        int horizonMinutes = 24 * 60;
+        // Необязательные ограничения: по умолчанию не действуют.
+        // Стоимость не больше maxPrice, прибытие строго раньше arriveBefore
+        double maxPrice = std::numeric_limits<double>::infinity();
+        qint32 arriveBefore = std::numeric_limits<qint32>::max();
+    };
+
+    // Парето-оптимальные поездки по прибытию, стоимости и числу пересадок, по возрастанию прибытия
+    QVector<Journey> search(const CityRouteIndex &index, const Query &query);
+
+    // Все города, достижимые из query.from в пределах ограничений запроса (query.to не используется).
+    // Один проход без города назначения; порядок - по CityId
+    QVector<ReachableCity> reachable(const CityRouteIndex &index, const Query &query);
+
+private:
+    struct Label {
+        qint32 arrival = 0;
+        double price = 0;
+        qint32 parent = -1;         // метка, с которой сели на рейс; -1 - город отправления
+        qint32 slot = -1;
+        qint32 boardStop = -1;
+        qint32 alightStop = -1;
+        qint32 tripDeparture = 0;
+        quint32 tripId = 0;
+    };
+
+    // Рейс, на который уже сели в текущем просмотре маршрута
+    struct RouteLabel {
+        qint32 tripDeparture = 0;
+        quint32 tripId = 0;
+        qint32 boardStop = -1;
+        qint32 parent = -1;
+        double basePrice = 0;       // стоимость до посадки минус накопленная цена маршрута до нее
+    };
+
+    // Заполняет наборы меток; false - запрос недопустим
+    bool run(const CityRouteIndex &index, const Query &query);
+    QVector<qint32>& bag(int round, CityId city) { return m_bags[round * m_cityCount + city]; }
+    bool dominated(CityId city, int round, qint32 arrival, double price) const;
+    bool addLabel(CityId city, int round, const Label &label);
+    void scanRoute(qint32 slot, qint32 fromPosition, int round, const Query &query, qint32 limit);
+    Journey journeyFrom(qint32 label) const;
+
+    const CityRouteIndex *m_index = nullptr;
+    qsizetype m_cityCount = 0;
+    CityId m_target = CityDictionary::InvalidCityId;
+
+    QVector<Label> m_labels;
+    // Номера меток по раундам: элемент [round * m_cityCount + city]
+    QVector<QVector<qint32>> m_bags;
+    RoundQueue m_queue;
+    QVector<RouteLabel> m_routeBag;
+};
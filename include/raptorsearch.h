@@ -0,0 +1,52 @@
+#pragma once
+#include "cityrouteindex.h"
+#include "journey.h"
+#include "roundqueue.h"
+#include <QVector>
+
+// Поиск поездок с пересадками по раундам (RAPTOR): раунд k находит лучшие прибытия,
+// использующие k рейсов. Маршруты в раунде просматриваются один раз от самой ранней
+// отмеченной остановки, поэтому запрос не зависит от числа всех остановок сети.
+// Остановки сети - города: пересадка возможна между любыми маршрутами в одном городе.
+// Объект хранит рабочие массивы между запросами и не используется из нескольких потоков
+class RaptorSearch {
+public:
+    struct Query {
+        CityId from = CityDictionary::InvalidCityId;
+        CityId to = CityDictionary::InvalidCityId;
+        qint32 departAfter = Trip::INVALID_MINUTES;  // минуты, как в Trip
+        int maxTransfers = 2;
+        int minTransferMinutes = 10;
+        int horizonMinutes = 24 * 60;                // рейсы позже departAfter + horizon не рассматриваются
+    };
+
+    // Парето-набор по (прибытие, число пересадок): для каждого числа пересадок - поездка,
+    // прибывающая строго раньше всех поездок с меньшим числом пересадок; по возрастанию пересадок
+    QVector<Journey> search(const CityRouteIndex &index, const Query &query);
+
+private:
+    struct Label {
+        qint32 slot = -1;           // -1 - город отправления, без рейса
+        qint32 boardStop = -1;
+        qint32 alightStop = -1;
+        qint32 tripDeparture = 0;
+        quint32 tripId = 0;
+    };
+
+    void reset(qsizetype cityCount, int rounds);
+    void scanRoute(qint32 slot, qint32 fromPosition, int round, const Query &query, qint32 limit);
+    Journey journeyTo(CityId city, int round) const;
+
+    qint32& arrival(int round, CityId city) { return m_arrivals[round * m_cityCount + city]; }
+    Label& label(int round, CityId city) { return m_labels[round * m_cityCount + city]; }
+
+    const CityRouteIndex *m_index = nullptr;
+    qsizetype m_cityCount = 0;
+    CityId m_target = CityDictionary::InvalidCityId;
+
+    // Прибытия и метки по раундам: элемент [round * m_cityCount + city]
+    QVector<qint32> m_arrivals;
+    QVector<Label> m_labels;
+    QVector<qint32> m_best;
+    RoundQueue m_queue;
+};
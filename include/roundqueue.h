@@ -0,0 +1,36 @@
+#pragma once
+#include "cityrouteindex.h"
+#include <QVector>
+
+// Общая часть поиска по раундам (RaptorSearch, ParetoSearch): города, улучшенные в раунде,
+// и маршруты через них, которые нужно просмотреть в следующем раунде с самой ранней
+// отмеченной остановки. Массивы переиспользуются между запросами
+class RoundQueue {
+public:
+    void reset(qsizetype cityCount, qint32 slotCount);
+
+    // Город улучшен в текущем раунде (повторная отметка ничего не меняет)
+    void mark(CityId city);
+    bool isEmpty() const { return m_markedCities.isEmpty(); }
+
+    // Переводит отмеченные города в очередь маршрутов и снимает отметки
+    void collectRoutes(const CityRouteIndex &index);
+
+    // Вызывает visit(slot, fromPosition) для каждого маршрута очереди и очищает ее.
+    // visit может отмечать города: они попадут в очередь следующего раунда
+    template<typename Visit>
+    void forEachRoute(Visit visit) {
+        for (qint32 slot : std::as_const(m_queuedSlots)) {
+            visit(slot, m_queuedFrom[slot]);
+            m_queuedFrom[slot] = -1;
+        }
+        m_queuedSlots.clear();
+    }
+
+private:
+    QVector<bool> m_marked;
+    QVector<CityId> m_markedCities;
+    // Самая ранняя отмеченная остановка каждого маршрута в очереди (-1 - маршрута в очереди нет)
+    QVector<qint32> m_queuedFrom;
+    QVector<qint32> m_queuedSlots;
+};
@@ -1,42 +1,175 @@
 #pragma once
 #include "stop.h"
+#include "citydictionary.h"
+#include "trip.h"
+#include "triprule.h"
+#include "servicecalendar.h"
 #include <QString>
 #include <QVector>
+#include <QSharedDataPointer>
 #include <QDateTime>
 #include <memory>
 
-class Trip;
+// Данные маршрута, общие для всех его копий до первого изменения
+class RouteData : public QSharedData {
+public:
+    quint32 m_id = 0;
+    QString m_name;
+
+    // Остановки хранятся столбцами: i-й элемент каждого массива описывает i-ю остановку
+    QVector<quint32> m_stopIds;
+    QVector<CityId> m_stopCityIds;
+    QVector<int> m_stopDurations;
+    QVector<double> m_stopPrices;
+
+    // Накопленные суммы: i-й элемент - сумма по остановкам 0..i включительно
+    QVector<int> m_cumulativeDurations;
+    QVector<double> m_cumulativePrices;
+
+    // Рейсы упорядочены по времени отправления (в минутах, см. Trip)
+    QVector<qint32> m_tripDepartures;
+    QVector<quint32> m_tripIds;
+
+    // Повторяющиеся рейсы хранятся правилами и разворачиваются по запросу
+    QVector<TripRule> m_tripRules;
+
+    // Дни, в которые есть хотя бы одно отправление: отдельные рейсы и правила
+    ServiceCalendar m_serviceDays;
 
+    // Номер версии данных, см. Route::revision()
+    quint64 m_revision = 0;
+};
+
+// Маршрут с неявным разделением данных: копирование - O(1),
+// данные копируются при первом изменении одной из копий
 class Route {
 public:
     explicit Route(const QString &name = "");
-    ~Route();
-    Route(const Route& other);
-    Route& operator=(const Route& other);
+    Route(const Route& other) = default;
+    Route& operator=(const Route& other) = default;
+
+    // Обе копии ссылаются на одни и те же данные (ни одна не изменялась после копирования)
+    bool sharesDataWith(const Route& other) const { return d == other.d; }
+    // Номер версии данных: новый при создании и после каждого изменения, общий у неизмененных копий.
+    // По нему индексы находят измененные маршруты, не храня их копий
+    quint64 revision() const { return d->m_revision; }
 
+    quint32 id() const { return d->m_id; }
+    void setId(quint32 id) {
+        d->m_id = id;
+        touch();
+    }
     QString name() const;
 
-    void addStop(const QString &city, int durationMinutes, double price);
-    void insertStop(int position, const QString &city, int durationMinutes, double price);
+    void addStop(const QString &city, int durationMinutes, double price, quint32 id = 0);
+    void addStop(CityId city, int durationMinutes, double price, quint32 id = 0);
+    void insertStop(int position, const QString &city, int durationMinutes, double price, quint32 id = 0);
+    void insertStop(int position, CityId city, int durationMinutes, double price, quint32 id = 0);
     void removeStop(int position);
+
+    // Доступ к остановке по номеру за O(1), без выделения памяти
+    quint32 stopId(int position) const { return d->m_stopIds[position]; }
+    CityId stopCityId(int position) const { return d->m_stopCityIds[position]; }
+    QString stopCity(int position) const { return CityDictionary::instance().name(d->m_stopCityIds[position]); }
+    int stopDuration(int position) const { return d->m_stopDurations[position]; }
+    double stopPrice(int position) const { return d->m_stopPrices[position]; }
+    void setStopId(int position, quint32 id) {
+        d->m_stopIds[position] = id;
+        touch();
+    }
+
+    // Столбцы остановок целиком - для проходов по всему маршруту
+    const QVector<quint32>& stopIds() const { return d->m_stopIds; }
+    const QVector<CityId>& stopCityIds() const { return d->m_stopCityIds; }
+    const QVector<int>& stopDurations() const { return d->m_stopDurations; }
+    const QVector<double>& stopPrices() const { return d->m_stopPrices; }
+
+    // Совместимость со старым интерфейсом списка: возвращаются копии остановок,
+    // их изменение не затрагивает маршрут
     std::shared_ptr<Stop> getStop(int position) const;
     std::shared_ptr<Stop> firstStop() const;
     QVector<std::shared_ptr<Stop>> getAllStops() const;
 
     int totalDuration() const;
     double totalPrice() const;
+
+    // Время в пути и стоимость участка от остановки fromStop (включительно)
+    // до toStop (не включительно) - разность накопленных сумм, O(1)
+    int segmentDuration(int fromStop, int toStop) const;
+    double segmentPrice(int fromStop, int toStop) const;
+
+    // Минуты от отправления до прибытия на остановку position
+    int arrivalOffset(int position) const { return d->m_cumulativeDurations[position]; }
+    const QVector<int>& arrivalOffsets() const { return d->m_cumulativeDurations; }
+
     int totalStops() const;
     QString info() const;
     QString detailedInfo() const;
 
-    void addTrip(const QDateTime &departure);
-    QVector<std::shared_ptr<Trip>>& trips();
-    const QVector<std::shared_ptr<Trip>>& trips() const;
-    void setName(const QString &name) { m_name = name; }
+    // Рейс встает на место по времени отправления (после рейсов с тем же временем);
+    // возвращается его номер
+    int addTrip(const QDateTime &departure, quint32 id = 0);
+    int addTrip(qint32 departureMinutes, quint32 id = 0);
+    // Вставка на заданное место; бросает RouteException, если порядок рейсов нарушится
+    void insertTrip(int position, qint32 departureMinutes, quint32 id = 0);
+    void removeTrip(int position);
+    void setTripId(int position, quint32 id) {
+        Q_ASSERT(position >= 0 && position < tripCount());
+        d->m_tripIds[position] = id;
+        touch();
+    }
+
+    int tripCount() const { return static_cast<int>(d->m_tripIds.size()); }
+    Trip trip(int position) const {
+        Q_ASSERT(position >= 0 && position < tripCount());
+        return Trip::fromMinutes(d->m_tripDepartures[position], d->m_tripIds[position]);
+    }
+    qint32 tripDeparture(int position) const {
+        Q_ASSERT(position >= 0 && position < tripCount());
+        return d->m_tripDepartures[position];
+    }
+    quint32 tripId(int position) const {
+        Q_ASSERT(position >= 0 && position < tripCount());
+        return d->m_tripIds[position];
+    }
+    const QVector<qint32>& tripDepartures() const { return d->m_tripDepartures; }
+    const QVector<quint32>& tripIds() const { return d->m_tripIds; }
+
+    // Номера рейсов с отправлением в [fromMinutes, toMinutes) - двоичным поиском
+    std::pair<int, int> tripRange(qint32 fromMinutes, qint32 toMinutes) const;
+
+    // Правила повторяющихся рейсов
+    const QVector<TripRule>& tripRules() const { return d->m_tripRules; }
+    void addTripRule(const TripRule &rule);
+    void insertTripRule(int position, const TripRule &rule);
+    void setTripRule(int position, const TripRule &rule);
+    void removeTripRule(int position);
+
+    // Рейсы с отправлением в [fromMinutes, toMinutes): отдельные рейсы и рейсы по правилам,
+    // развернутые только для этого окна, по возрастанию времени. У рейсов по правилам id = 0
+    QVector<Trip> trips(qint32 fromMinutes, qint32 toMinutes) const;
+    bool hasDeparturesBetween(qint32 fromMinutes, qint32 toMinutes) const;
+    // Ближайшее отправление с первой остановки не раньше fromMinutes (или Trip::INVALID_MINUTES).
+    // В tripId записывается id отдельного рейса или 0 для рейса по правилу
+    qint32 nextDeparture(qint32 fromMinutes, quint32 *tripId = nullptr) const;
+
+    // Календарь обслуживания маршрута: проверка дня - проверка одного бита
+    const ServiceCalendar& serviceDays() const { return d->m_serviceDays; }
+    bool runsOn(const QDate &date) const { return d->m_serviceDays.runsOn(date); }
+
+    void setName(const QString &name) {
+        d->m_name = name;
+        touch();
+    }
 
 private:
-    QString m_name;
-    std::shared_ptr<Stop> m_head = nullptr;
-    std::shared_ptr<Stop> m_tail = nullptr;
-    QVector<std::shared_ptr<Trip>> m_trips;
+    static quint64 nextRevision();
+    void touch() { d->m_revision = nextRevision(); }
+
+    void updateCumulative(int fromPosition);
+    // Календарь пересобирается целиком только при изменении правил
+    void updateServiceDays();
+    void updateServiceDay(qint32 day);
+
+    QSharedDataPointer<RouteData> d;
 };
@@ -1,5 +1,14 @@
 #pragma once
 #include "route.h"
+#include "cityrouteindex.h"
+#include "connectivitymatrix.h"
+#include "routerangeindex.h"
+#include "raptorsearch.h"
+#include "paretosearch.h"
+#include "connectionscan.h"
+#include "journey.h"
+#include <QCache>
+#include <QObject>
 #include <QVector>
 #include <QString>
 #include <QDateTime>
@@ -7,52 +16,241 @@
 #include <algorithm>
 
 class Company;
+class FileDatabase;
 
+// Поиск маршрутов. Индекс городов хранится между запросами и синхронизируется с переданными
+// компаниями, только когда они сменились: передан другой список или база (setDatabase)
+// опубликовала новую версию. Один объект не используется из нескольких потоков.
+// Ответы findRoutes, findFastestRoute, findCheapestRoute и findRoutesWithTransfers кэшируются
+// с версией проиндексированных данных в ключе; кэш сбрасывается, как только синхронизация
+// находит измененные маршруты или новые объекты тех же маршрутов, поэтому ответ из кэша
+// ссылается на те же объекты, что и переданные компании
 class RouteFinder {
 public:
+    static constexpr int DEFAULT_MIN_TRANSFER_MINUTES = 10;
+    static constexpr qsizetype DEFAULT_CACHE_CAPACITY = 1024;
+    // Пакеты меньше этого размера выполняются в текущем потоке
+    static constexpr qsizetype PARALLEL_BATCH_MIN_PAIRS = 256;
+
+    // Счетчики кэша ответов
+    struct CacheStats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 invalidations = 0;  // сбросы из-за измененных маршрутов
+        qsizetype size = 0;
+        qsizetype capacity = 0;
+
+        double hitRate() const { return hits + misses == 0 ? 0.0 : double(hits) / double(hits + misses); }
+    };
+
+    // Пара "откуда - куда" для пакетных запросов
+    struct OdPair {
+        QString fromCity;
+        QString toCity;
+    };
+
+    // Критерий выбора прямого маршрута
+    enum class RouteCriterion {
+        Fastest,
+        Cheapest
+    };
+
     RouteFinder();
-    ~RouteFinder() = default;
+    ~RouteFinder();
+
+    // База, чьи версии передаются в запросы. Ее сигнал companiesChanged и новая generation()
+    // приводят к синхронизации индекса (и сбросу кэша, если маршруты изменились) даже с тем же
+    // списком компаний. Удаление базы отвязывает ее
+    void setDatabase(const FileDatabase* database);
+    // Маршруты изменены на месте, без публикации нового списка: индекс синхронизируется при следующем запросе
+    void invalidateIndex();
+
+    void setCacheCapacity(qsizetype entries);
+    CacheStats cacheStats() const;
+    void resetCacheStats();
     
     // Поиск маршрутов по городу отправления и назначения
-    QVector<std::shared_ptr<Route>> findRoutes(const QString& fromCity, 
-                                                const QString& toCity,
-                                                const QVector<Company>& companies) const;
+    QVector<std::shared_ptr<const Route>> findRoutes(const QString& fromCity, 
+                                                      const QString& toCity,
+                                                      const QVector<Company>& companies) const;
     
-    // Поиск маршрутов с пересадками
-    QVector<QVector<std::shared_ptr<Route>>> findRoutesWithTransfers(
+    // Поиск поездок с пересадками, отправляющихся не раньше departAfter.
+    // Возвращает лучшую поездку для каждого числа пересадок до maxTransfers, если она прибывает
+    // раньше поездок с меньшим числом пересадок; пересадка в городе занимает не меньше minTransferMinutes
+    QVector<Journey> findRoutesWithTransfers(
+        const QString& fromCity,
+        const QString& toCity,
+        const QDateTime& departAfter,
+        const QVector<Company>& companies,
+        int maxTransfers = 2,
+        int minTransferMinutes = DEFAULT_MIN_TRANSFER_MINUTES) const;
+
+    // Поездка с самым ранним прибытием без ограничения числа пересадок: один проход по сети связей
+    // с отправлением в течение суток после departAfter. Сеть общая с findProfile и строится заново,
+    // только если маршруты изменились или она не покрывает эти сутки. Пустая поездка - если не доехать
+    Journey findEarliestArrival(
+        const QString& fromCity,
+        const QString& toCity,
+        const QDateTime& departAfter,
+        const QVector<Company>& companies,
+        int minTransferMinutes = DEFAULT_MIN_TRANSFER_MINUTES) const;
+
+    // Все недоминируемые поездки с отправлением в [windowStart, windowEnd] за один проход (профиль).
+    // Сеть связей строится на окно плюс сутки и переиспользуется, пока маршруты не изменились
+    QVector<Journey> findProfile(
+        const QString& fromCity,
+        const QString& toCity,
+        const QDateTime& windowStart,
+        const QDateTime& windowEnd,
+        const QVector<Company>& companies,
+        int minTransferMinutes = DEFAULT_MIN_TRANSFER_MINUTES) const;
+
+    // Все Парето-оптимальные поездки по времени прибытия, стоимости и числу пересадок.
+    // Необязательные ограничения: maxPrice < 0 и недействительный arriveBefore их отключают;
+    // прибытие должно быть строго раньше arriveBefore
+    QVector<Journey> findParetoJourneys(
         const QString& fromCity,
         const QString& toCity,
+        const QDateTime& departAfter,
         const QVector<Company>& companies,
-        int maxTransfers = 2) const;
+        int maxTransfers = 2,
+        int minTransferMinutes = DEFAULT_MIN_TRANSFER_MINUTES,
+        double maxPrice = -1,
+        const QDateTime& arriveBefore = QDateTime()) const;
     
+    // Порядок городов в ответе findReachableCities
+    enum class ReachOrder {
+        ByArrival,
+        ByPrice
+    };
+
+    // Города, достижимые из fromCity с отправлением не раньше departAfter в пределах бюджета
+    // времени и/или стоимости (отрицательное значение - без ограничения)
+    QVector<ReachableCity> findReachableCities(
+        const QString& fromCity,
+        const QDateTime& departAfter,
+        const QVector<Company>& companies,
+        int timeBudgetMinutes = -1,
+        double fareBudget = -1,
+        ReachOrder order = ReachOrder::ByArrival,
+        int maxTransfers = 2,
+        int minTransferMinutes = DEFAULT_MIN_TRANSFER_MINUTES) const;
+
     // Поиск маршрутов по дате отправления
-    QVector<std::shared_ptr<Route>> findRoutesByDate(const QDate& date,
-                                                      const QVector<Company>& companies) const;
+    QVector<std::shared_ptr<const Route>> findRoutesByDate(const QDate& date,
+                                                            const QVector<Company>& companies) const;
+
+    // Маршруты с отправлением в [start, end)
+    QVector<std::shared_ptr<const Route>> findRoutesByTimeRange(const QDateTime& start,
+                                                                 const QDateTime& end,
+                                                                 const QVector<Company>& companies) const;
+
+    // Маршруты, работающие хотя бы в один из дней календаря
+    QVector<std::shared_ptr<const Route>> findRoutesByDates(const ServiceCalendar& days,
+                                                             const QVector<Company>& companies) const;
     
     // Поиск маршрутов в ценовом диапазоне
-    QVector<std::shared_ptr<Route>> findRoutesByPriceRange(double minPrice,
-                                                            double maxPrice,
-                                                            const QVector<Company>& companies) const;
+    QVector<std::shared_ptr<const Route>> findRoutesByPriceRange(double minPrice,
+                                                                  double maxPrice,
+                                                                  const QVector<Company>& companies) const;
     
     // Поиск самого быстрого маршрута
-    std::shared_ptr<Route> findFastestRoute(const QString& fromCity,
-                                             const QString& toCity,
-                                             const QVector<Company>& companies) const;
+    std::shared_ptr<const Route> findFastestRoute(const QString& fromCity,
+                                                   const QString& toCity,
+                                                   const QVector<Company>& companies) const;
     
     // Поиск самого дешевого маршрута
-    std::shared_ptr<Route> findCheapestRoute(const QString& fromCity,
-                                              const QString& toCity,
-                                              const QVector<Company>& companies) const;
+    std::shared_ptr<const Route> findCheapestRoute(const QString& fromCity,
+                                                    const QString& toCity,
+                                                    const QVector<Company>& companies) const;
     
+    // Лучший прямой маршрут для каждой пары (nullptr, если его нет) в порядке pairs.
+    // Индекс синхронизируется один раз, затем пары делятся на части и решаются на всех ядрах
+    QVector<std::shared_ptr<const Route>> findRoutesBatch(const QVector<OdPair>& pairs,
+                                                          RouteCriterion criterion,
+                                                          const QVector<Company>& companies) const;
+
     // Проверка наличия прямого маршрута
     bool hasDirectRoute(const QString& fromCity,
                         const QString& toCity,
                         const QVector<Company>& companies) const;
+
+    // Можно ли в принципе доехать не более чем с maxTransfers пересадками (без учета расписания)
+    bool hasConnection(const QString& fromCity,
+                       const QString& toCity,
+                       const QVector<Company>& companies,
+                       int maxTransfers = 2) const;
     
 private:
-    bool routeContainsCity(std::shared_ptr<Route> route, const QString& city) const;
-    int findCityPosition(std::shared_ptr<Route> route, const QString& city) const;
-    QVector<std::shared_ptr<Route>> getAllRoutes(const QVector<Company>& companies) const;
+    bool routeContainsCity(std::shared_ptr<const Route> route, const QString& city) const;
+    int findCityPosition(std::shared_ptr<const Route> route, const QString& city) const;
+    QVector<std::shared_ptr<const Route>> getAllRoutes(const QVector<Company>& companies) const;
+    void syncIndex(const QVector<Company>& companies) const;
+    // Сеть связей, содержащая все связи с отправлением в [fromMinutes, toMinutes); индекс уже синхронизирован
+    const ConnectionScan& connectionsCovering(const QVector<Company>& companies, qint32 fromMinutes,
+                                              qint32 toMinutes) const;
+    std::shared_ptr<const Route> findBestRoute(const QString& fromCity,
+                                               const QString& toCity,
+                                               RouteCriterion criterion,
+                                               const QVector<Company>& companies) const;
+    // Только читают синхронизированный индекс; found - буфер вызывающего потока
+    std::shared_ptr<const Route> bestDirectRoute(const OdPair& pair, RouteCriterion criterion, QVector<qint32>& found) const;
+    std::shared_ptr<const Route> bestDirectRoute(CityId from, CityId to, RouteCriterion criterion, QVector<qint32>& found) const;
+
+    enum class QueryKind : quint8 {
+        Routes,
+        Fastest,
+        Cheapest,
+        Transfers
+    };
+
+    // Нормализованные параметры запроса: города - номера, время - минуты
+    struct QueryKey {
+        quint64 dataset = 0;        // версия данных индекса, см. m_datasetVersion
+        QueryKind kind = QueryKind::Routes;
+        CityId from = CityDictionary::InvalidCityId;
+        CityId to = CityDictionary::InvalidCityId;
+        qint32 departAfter = 0;
+        qint32 maxTransfers = 0;
+        qint32 minTransferMinutes = 0;
+
+        bool operator==(const QueryKey& other) const = default;
+        friend size_t qHash(const QueryKey& key, size_t seed = 0) {
+            return qHashMulti(seed, key.dataset, static_cast<int>(key.kind), key.from, key.to,
+                              key.departAfter, key.maxTransfers, key.minTransferMinutes);
+        }
+    };
+
+    struct CachedResult {
+        QVector<std::shared_ptr<const Route>> routes;     // для Fastest/Cheapest - не больше одного
+        QVector<Journey> journeys;
+    };
+
+    // nullptr, если кэш выключен или ответа нет; обновляет счетчики
+    const CachedResult* cachedResult(const QueryKey& key) const;
+    void storeResult(const QueryKey& key, CachedResult result) const;
+
+    mutable CityRouteIndex m_cityIndex;
+    mutable ConnectivityMatrix m_connectivity;
+    mutable RouteRangeIndex m_rangeIndex;
+    mutable RaptorSearch m_raptor;
+    mutable ParetoSearch m_pareto;
+    mutable ConnectionScan m_connections;
+    mutable bool m_connectionsValid = false;
+
+    mutable QCache<QueryKey, CachedResult> m_cache{DEFAULT_CACHE_CAPACITY};
+    mutable CacheStats m_cacheStats;
+    // Растет при каждой синхронизации, изменившей маршруты или их объекты
+    mutable quint64 m_datasetVersion = 0;
+
+    const FileDatabase* m_database = nullptr;
+    QMetaObject::Connection m_changedConnection;
+    QMetaObject::Connection m_destroyedConnection;
+    // Список и версия базы, с которыми последний раз синхронизирован индекс. Копия удерживает
+    // буфер списка, поэтому совпадение адреса означает тот же список (сами маршруты и так держит индекс)
+    mutable QVector<Company> m_indexedCompanies;
+    mutable quint64 m_indexedGeneration = 0;
+    mutable bool m_indexStale = true;
 };
 
 
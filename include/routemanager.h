@@ -2,6 +2,7 @@
 #include "route.h"
 #include <QVector>
 #include <QString>
+#include <QHash>
 #include <memory>
 #include <algorithm>
 #include <functional>
@@ -18,6 +19,7 @@ public:
     void removeRoute(const QString& name);
     
     std::shared_ptr<T> findRoute(const QString& name) const;
+    std::shared_ptr<T> findRouteById(quint32 id) const;
     QVector<std::shared_ptr<T>> findRoutes(const std::function<bool(std::shared_ptr<T>)>& predicate) const;
     
     QVector<std::shared_ptr<T>> getAllRoutes() const;
@@ -43,6 +45,7 @@ public:
     
 private:
     QVector<std::shared_ptr<T>> m_routes;
+    QHash<quint32, std::shared_ptr<T>> m_routesById;    // поиск по идентификатору за O(1)
 };
 
 // Реализация шаблонного класса
@@ -50,12 +53,18 @@ template<typename T>
 void RouteManager<T>::addRoute(std::shared_ptr<T> route) {
     if (route) {
         m_routes.append(route);
+        if (route->id() != 0) {
+            m_routesById.insert(route->id(), route);
+        }
     }
 }
 
 template<typename T>
 void RouteManager<T>::removeRoute(std::shared_ptr<T> route) {
     m_routes.removeAll(route);
+    if (route && m_routesById.value(route->id()) == route) {
+        m_routesById.remove(route->id());
+    }
 }
 
 template<typename T>
@@ -64,6 +73,9 @@ void RouteManager<T>::removeRoute(const QString& name) {
         [&name](std::shared_ptr<T> route) {
             return route && route->name() == name;
         }), m_routes.end());
+    m_routesById.removeIf([&name](const auto& item) {
+        return item.value()->name() == name;
+    });
 }
 
 template<typename T>
@@ -75,6 +87,11 @@ std::shared_ptr<T> RouteManager<T>::findRoute(const QString& name) const {
     return (it != m_routes.end()) ? *it : nullptr;
 }
 
+template<typename T>
+std::shared_ptr<T> RouteManager<T>::findRouteById(quint32 id) const {
+    return m_routesById.value(id);
+}
+
 template<typename T>
 QVector<std::shared_ptr<T>> RouteManager<T>::findRoutes(const std::function<bool(std::shared_ptr<T>)>& predicate) const {
     QVector<std::shared_ptr<T>> result;
@@ -90,6 +107,7 @@ QVector<std::shared_ptr<T>> RouteManager<T>::getAllRoutes() const {
 template<typename T>
 void RouteManager<T>::clear() {
     m_routes.clear();
+    m_routesById.clear();
 }
 
 template<typename T>
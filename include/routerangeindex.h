@@ -0,0 +1,62 @@
+#pragma once
+#include "cityrouteindex.h"
+#include <QVector>
+
+// Упорядоченные индексы для запросов по диапазону: отправления рейсов по времени и маршруты по цене.
+// Номера маршрутов те же, что в CityRouteIndex; после синхронизации индекса update() заменяет
+// записи только измененных маршрутов. Прежние записи маршрута не вырезаются из массивов, а
+// становятся мертвыми со сменой его метки; новые попадают в небольшой упорядоченный массив
+// добавлений. Сжатие вливает добавления в основной массив и выбрасывает мертвые записи, когда их
+// набирается заметная доля, поэтому правка маршрута стоит порядка числа его рейсов и корня
+// из размера индекса, а не всего индекса. Рейсы по правилам расписания не разворачиваются:
+// маршруты с правилами проверяются отдельно, их обычно немного. Класс не потокобезопасен
+class RouteRangeIndex {
+public:
+    // Если с прошлого вызова индекс синхронизировался ровно один раз, обновляются только
+    // маршруты из index.touchedSlots(), иначе индексы строятся заново
+    void update(const CityRouteIndex& index);
+    void rebuild(const CityRouteIndex& index);
+
+    // Номера маршрутов с отправлением в [fromMinutes, toMinutes), без повторов
+    void slotsDepartingBetween(const CityRouteIndex& index, qint32 fromMinutes, qint32 toMinutes,
+                               QVector<qint32>& found) const;
+    // Номера маршрутов с полной ценой в [minPrice, maxPrice]
+    void slotsInPriceRange(double minPrice, double maxPrice, QVector<qint32>& found) const;
+
+private:
+    struct Departure {
+        qint32 minutes = 0;
+        qint32 slot = -1;
+        quint32 stamp = 0;      // метка маршрута на момент добавления
+
+        bool operator<(const Departure& other) const {
+            return minutes != other.minutes ? minutes < other.minutes : slot < other.slot;
+        }
+    };
+
+    struct Price {
+        double price = 0;
+        qint32 slot = -1;
+        quint32 stamp = 0;
+
+        bool operator<(const Price& other) const {
+            return price != other.price ? price < other.price : slot < other.slot;
+        }
+    };
+
+    // Помечает мертвыми записи маршрутов changed и добавляет их текущие данные
+    void replaceSlots(const CityRouteIndex& index, const QVector<qint32>& changed);
+    // Вливает добавления в основные массивы и выбрасывает мертвые записи
+    void compact();
+    bool isLive(qint32 slot, quint32 stamp) const { return m_slotStamps[slot] == stamp; }
+
+    QVector<Departure> m_departures;
+    QVector<Departure> m_recentDepartures;
+    QVector<Price> m_prices;
+    QVector<Price> m_recentPrices;
+    QVector<quint32> m_slotStamps;      // текущая метка маршрута: записи с другой меткой мертвые
+    QVector<qsizetype> m_slotEntries;   // живых записей маршрута (отправления и цена)
+    qsizetype m_deadEntries = 0;
+    QVector<qint32> m_ruleSlots;        // маршруты с правилами расписания, по возрастанию
+    quint64 m_syncNumber = 0;
+};
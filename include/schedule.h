@@ -7,28 +7,31 @@
 #include <memory>
 #include <algorithm>
 
-// Контейнерный класс для расписания с итераторами
+// Контейнерный класс для расписания с итераторами.
+// Рейсы хранятся значениями и сравниваются по времени в минутах
 class Schedule {
 public:
     Schedule();
     ~Schedule() = default;
     
-    void addTrip(std::shared_ptr<Route> route, std::shared_ptr<Trip> trip);
-    void removeTrip(std::shared_ptr<Route> route, std::shared_ptr<Trip> trip);
+    void addTrip(std::shared_ptr<Route> route, const Trip& trip);
+    // Добавляет рейсы маршрута с отправлением в [start, end), включая рейсы по правилам расписания
+    void addRouteTrips(std::shared_ptr<Route> route, const QDateTime& start, const QDateTime& end);
+    void removeTrip(std::shared_ptr<Route> route, const Trip& trip);
     
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> getTripsByDate(const QDate& date) const;
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> getTripsByRoute(std::shared_ptr<Route> route) const;
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> getTripsByTimeRange(
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> getTripsByDate(const QDate& date) const;
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> getTripsByRoute(std::shared_ptr<Route> route) const;
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> getTripsByTimeRange(
         const QDateTime& start, const QDateTime& end) const;
     
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> getAllTrips() const;
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> getAllTrips() const;
     
     void sortByDepartureTime();
     void sortByRoute();
     
     // Итераторы для STL-совместимости
-    using ScheduleIterator = QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>>::iterator;
-    using ConstScheduleIterator = QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>>::const_iterator;
+    using ScheduleIterator = QVector<std::pair<std::shared_ptr<Route>, Trip>>::iterator;
+    using ConstScheduleIterator = QVector<std::pair<std::shared_ptr<Route>, Trip>>::const_iterator;
     
     ScheduleIterator begin();
     ScheduleIterator end();
@@ -36,7 +39,7 @@ public:
     ConstScheduleIterator end() const;
     
     // Перегрузка операций
-    Schedule& operator+=(const std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>& item);
+    Schedule& operator+=(const std::pair<std::shared_ptr<Route>, Trip>& item);
     
     // Hidden friend operator
     friend Schedule operator+(const Schedule& lhs, const Schedule& rhs) {
@@ -51,7 +54,7 @@ public:
     friend QString getScheduleInfo(const Schedule& schedule);
     
 private:
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> m_schedule;
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> m_schedule;
 };
 
 // Дружественная функция
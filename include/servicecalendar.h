@@ -0,0 +1,51 @@
+#pragma once
+#include <QDate>
+#include <QVector>
+#include <limits>
+
+// Календарь обслуживания: битовая карта дней, в которые есть отправления.
+// Дни - номера суток от 1970-01-01. Биты хранятся 64-битными словами, выровненными
+// по номеру дня, поэтому объединение и пересечение календарей - пословные OR/AND
+class ServiceCalendar {
+public:
+    // Сутки недопустимого времени (Trip::INVALID_MINUTES): не отмечаются и не проверяются
+    static constexpr qint32 INVALID_DAY = std::numeric_limits<qint32>::min();
+
+    static qint32 dayNumber(const QDate &date);
+    static QDate dateOf(qint32 day);
+    // Номер суток, в которые попадает минута (минуты - как в Trip), или INVALID_DAY
+    static qint32 dayOfMinute(qint64 minutes);
+
+    ServiceCalendar() = default;
+    // Все дни с firstDay по lastDay включительно
+    ServiceCalendar(qint32 firstDay, qint32 lastDay);
+
+    bool runsOn(qint32 day) const;
+    bool runsOn(const QDate &date) const;
+
+    void setDay(qint32 day);
+    void clearDay(qint32 day);
+    void setDays(qint32 firstDay, qint32 lastDay);
+    void clear();
+
+    bool isEmpty() const;
+    int count() const;
+    // Есть ли общий день с другим календарем
+    bool intersects(const ServiceCalendar &other) const;
+
+    ServiceCalendar& operator|=(const ServiceCalendar &other);
+    ServiceCalendar& operator&=(const ServiceCalendar &other);
+    friend ServiceCalendar operator|(ServiceCalendar lhs, const ServiceCalendar &rhs) { return lhs |= rhs; }
+    friend ServiceCalendar operator&(ServiceCalendar lhs, const ServiceCalendar &rhs) { return lhs &= rhs; }
+
+    // Сравниваются отмеченные дни, а не размер хранилища
+    bool operator==(const ServiceCalendar &other) const;
+
+private:
+    quint64 word(qint32 index) const;
+    void reserveWords(qint32 firstWord, qint32 lastWord);
+
+    // Слово m_words[i] хранит дни (m_firstWord + i) * 64 .. (m_firstWord + i) * 64 + 63
+    qint32 m_firstWord = 0;
+    QVector<quint64> m_words;
+};
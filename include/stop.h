@@ -3,6 +3,7 @@
 #include <memory>
 
 struct Stop{
+    quint32 id = 0;     // 0 - идентификатор еще не назначен
     QString city;
     int durationMinutes;
     double price;
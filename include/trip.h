@@ -1,27 +1,60 @@
 #pragma once
+#include <QByteArrayView>
 #include <QDateTime>
 #include <QDebug>
+#include <QVector>
 #include <compare>
+#include <limits>
 
 class Route;
 
+// Рейс - компактное значение: время отправления в минутах и идентификатор.
+// Время - "настенные" минуты от 1970-01-01T00:00 без учета часового пояса;
+// в QDateTime оно переводится только для отображения
 class Trip {
 public:
-    explicit Trip(const QDateTime &departure = QDateTime());
+    static constexpr qint32 INVALID_MINUTES = std::numeric_limits<qint32>::min();
 
+    explicit Trip(const QDateTime &departure = QDateTime(), quint32 id = 0);
+    static Trip fromMinutes(qint32 departureMinutes, quint32 id = 0);
+
+    quint32 id() const;
+    void setId(quint32 id);
+    qint32 departureMinutes() const { return m_departure; }
     QDateTime departure() const;
     QDateTime arrival(const Route &route) const;
 
-    // Перегрузка операций
+    // Прибытие на остановку position и на все остановки сразу - по накопленным длительностям маршрута
+    QDateTime arrivalAt(const Route &route, int position) const;
+    QVector<QDateTime> stopArrivals(const Route &route) const;
+
+    // Перевод между QDateTime и минутами; недопустимая дата дает INVALID_MINUTES
+    static qint32 toMinutes(const QDateTime &dateTime);
+    static QDateTime toDateTime(qint32 minutes);
+
+    // Разбор "yyyy-MM-ddTHH:mm" (допускаются секунды ":ss", они отбрасываются) без QDateTime.
+    // Возвращает false, если строка другого вида или дата недопустима
+    static bool parseIsoMinutes(QByteArrayView text, qint32 &minutes);
+    // Запись в виде "yyyy-MM-ddTHH:mm"
+    static QByteArray formatIsoMinutes(qint32 minutes);
+
+    // Перегрузка операций: порядок по времени отправления, при равном времени - по id,
+    // поэтому равенство по <=> совпадает с ==
     bool operator==(const Trip& other) const = default;
-    auto operator<=>(const Trip& other) const;
+    std::strong_ordering operator<=>(const Trip& other) const {
+        if (const auto order = m_departure <=> other.m_departure; order != 0) {
+            return order;
+        }
+        return m_id <=> other.m_id;
+    }
 
     // Дружественная функция для вывода в отладку
     friend QDebug operator<<(QDebug debug, const Trip& trip) {
-        debug.nospace() << "Trip(departure=" << trip.m_departure.toString("dd.MM.yyyy HH:mm") << ")";
+        debug.nospace() << "Trip(departure=" << trip.departure().toString("dd.MM.yyyy HH:mm") << ")";
         return debug;
     }
 
 private:
-    QDateTime m_departure;
+    quint32 m_id = 0;
+    qint32 m_departure = INVALID_MINUTES;
 };
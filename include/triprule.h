@@ -0,0 +1,55 @@
+#pragma once
+#include "servicecalendar.h"
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QDate>
+#include <QString>
+#include <QTime>
+#include <QVector>
+
+// Правило повторяющихся рейсов: одни и те же времена отправления каждый день
+// с firstDay по lastDay включительно, кроме дней-исключений.
+// Рейсы по правилу не хранятся, а разворачиваются только для запрошенного окна времени
+class TripRule {
+public:
+    TripRule() = default;
+    TripRule(const QDate &firstDay, const QDate &lastDay, const QVector<QTime> &times,
+             const QVector<QDate> &exceptDays = {});
+
+    QDate firstDay() const;
+    QDate lastDay() const;
+    QVector<QTime> times() const;
+    QVector<QDate> exceptDays() const;
+
+    // Период не пуст и задано хотя бы одно время отправления
+    bool isValid() const;
+
+    // Дни, в которые правило работает: период без дней-исключений
+    const ServiceCalendar& calendar() const { return m_calendar; }
+    bool runsOn(const QDate &date) const;
+
+    // Дописывает в departures отправления в [fromMinutes, toMinutes) по возрастанию (минуты - как в Trip)
+    void expand(qint32 fromMinutes, qint32 toMinutes, QVector<qint32> &departures) const;
+    bool hasDeparturesBetween(qint32 fromMinutes, qint32 toMinutes) const;
+    // Ближайшее отправление не раньше fromMinutes или Trip::INVALID_MINUTES
+    qint32 nextDeparture(qint32 fromMinutes) const;
+    // Первое и последнее возможные отправления - границы для полного разворачивания
+    qint32 firstDeparture() const;
+    qint32 lastDeparture() const;
+
+    // Строковый вид "yyyy-MM-dd;yyyy-MM-dd;HH:mm,HH:mm;yyyy-MM-dd,..." (исключения могут отсутствовать)
+    static bool parse(QByteArrayView text, TripRule &rule);
+    QByteArray format() const;
+    // Описание для пользователя
+    QString description() const;
+
+    bool operator==(const TripRule &other) const = default;
+
+private:
+    // Дни - номера суток от 1970-01-01, времена - минуты от начала суток; оба массива упорядочены
+    qint32 m_firstDay = 0;
+    qint32 m_lastDay = -1;
+    QVector<qint16> m_times;
+    QVector<qint32> m_exceptDays;
+    ServiceCalendar m_calendar;
+};
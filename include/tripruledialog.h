@@ -0,0 +1,26 @@
+#pragma once
+#include "triprule.h"
+#include <QDialog>
+
+class QDateEdit;
+class QLineEdit;
+
+class TripRuleDialog : public QDialog{
+    Q_OBJECT
+public:
+    explicit TripRuleDialog(QWidget *parent = nullptr);
+
+    void setRule(const TripRule &rule);
+    TripRule rule() const;
+
+public slots:
+    void accept() override;
+
+private:
+    bool readInput(TripRule &rule, QString &error) const;
+
+    QDateEdit *deFirstDay;
+    QDateEdit *deLastDay;
+    QLineEdit *leTimes;
+    QLineEdit *leExceptions;
+};
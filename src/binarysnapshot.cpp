@@ -0,0 +1,387 @@
+#include "binarysnapshot.h"
+#include "DatabaseException.h"
+#include "route.h"
+#include "trip.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QHash>
+#include <QDateTime>
+#include <QtEndian>
+#include <array>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr std::array<char, 4> MAGIC = {'B', 'S', 'N', 'P'};
+constexpr qint64 HEADER_SIZE = 44;
+constexpr qint64 COMPANY_RECORD_SIZE = 16;
+constexpr qint64 ROUTE_RECORD_SIZE = 32;
+constexpr qint64 STOP_RECORD_SIZE = 20;
+constexpr qint64 RULE_RECORD_SIZE = 4;
+
+constexpr std::array<quint32, 256> makeCrc32Table() {
+    std::array<quint32, 256> table{};
+    for (quint32 i = 0; i < 256; ++i) {
+        quint32 value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+constexpr std::array<quint32, 256> CRC32_TABLE = makeCrc32Table();
+
+quint32 crc32(const uchar *data, qint64 size) {
+    quint32 crc = 0xFFFFFFFFu;
+    for (qint64 i = 0; i < size; ++i) {
+        crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template<typename T>
+void appendValue(QByteArray& out, T value) {
+    std::array<char, sizeof(T)> bytes;
+    qToLittleEndian(value, bytes.data());
+    out.append(bytes.data(), qsizetype(bytes.size()));
+}
+
+void appendDouble(QByteArray& out, double value) {
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendValue<quint64>(out, bits);
+}
+
+void appendVarint(QByteArray& out, qint64 value) {
+    // zigzag: небольшие отрицательные дельты тоже кодируются коротко
+    auto encoded = (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+    while (encoded >= 0x80) {
+        out.append(static_cast<char>((encoded & 0x7F) | 0x80));
+        encoded >>= 7;
+    }
+    out.append(static_cast<char>(encoded));
+}
+
+class StringTable {
+public:
+    quint32 intern(const QString& text) {
+        if (auto it = m_indexes.constFind(text); it != m_indexes.cend()) {
+            return it.value();
+        }
+        const auto index = static_cast<quint32>(m_offsets.size());
+        m_offsets.append(static_cast<quint32>(m_pool.size()));
+        m_pool.append(text.toUtf8());
+        m_indexes.insert(text, index);
+        return index;
+    }
+
+    quint32 count() const { return static_cast<quint32>(m_offsets.size()); }
+    const QByteArray& pool() const { return m_pool; }
+    const QVector<quint32>& offsets() const { return m_offsets; }
+
+private:
+    QHash<QString, quint32> m_indexes;
+    QVector<quint32> m_offsets;
+    QByteArray m_pool;
+};
+
+// Чтение с проверкой границ поверх отображенного в память файла
+class SnapshotReader {
+public:
+    SnapshotReader(const uchar *data, qint64 size) : m_data(data), m_size(size) {}
+
+    quint32 u32(qint64 offset) const {
+        require(offset, 4);
+        return qFromLittleEndian<quint32>(m_data + offset);
+    }
+
+    qint32 i32(qint64 offset) const {
+        require(offset, 4);
+        return qFromLittleEndian<qint32>(m_data + offset);
+    }
+
+    double f64(qint64 offset) const {
+        require(offset, 8);
+        const auto bits = qFromLittleEndian<quint64>(m_data + offset);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    qint64 varint(qint64& offset, qint64 limit) const {
+        quint64 encoded = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (offset >= limit) {
+                throw DatabaseException("Corrupted binary snapshot: truncated trip data");
+            }
+            const uchar byte = m_data[offset++];
+            encoded |= static_cast<quint64>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return static_cast<qint64>(encoded >> 1) ^ -static_cast<qint64>(encoded & 1);
+            }
+        }
+        throw DatabaseException("Corrupted binary snapshot: invalid varint");
+    }
+
+    QByteArrayView bytes(qint64 offset, qint64 length) const {
+        require(offset, length);
+        return QByteArrayView(m_data + offset, length);
+    }
+
+    void require(qint64 offset, qint64 length) const {
+        if (offset < 0 || length < 0 || offset + length > m_size) {
+            throw DatabaseException("Corrupted binary snapshot: section out of bounds");
+        }
+    }
+
+private:
+    const uchar *m_data;
+    qint64 m_size;
+};
+
+void checkIndex(quint64 first, quint64 count, quint64 total, const char *what) {
+    if (first + count > total) {
+        throw DatabaseException(QString("Corrupted binary snapshot: %1 index out of range").arg(what));
+    }
+}
+
+} // namespace
+
+void BinarySnapshot::write(const QString& filePath, const QVector<Company>& companies) {
+    StringTable strings;
+    QByteArray companyRecords;
+    QByteArray routeRecords;
+    QByteArray stopRecords;
+    QByteArray ruleRecords;
+    QByteArray tripStream;
+    quint32 routeCount = 0;
+    quint32 stopCount = 0;
+    quint32 tripCount = 0;
+    quint32 ruleCount = 0;
+
+    for (const auto &company : companies) {
+        appendValue<quint32>(companyRecords, company.id());
+        appendValue<quint32>(companyRecords, strings.intern(company.name()));
+        appendValue<quint32>(companyRecords, routeCount);
+        appendValue<quint32>(companyRecords, static_cast<quint32>(company.routes().size()));
+
+        for (const auto &route : company.routes()) {
+            const auto &departures = route->tripDepartures();
+            const auto &tripIds = route->tripIds();
+            const quint32 firstStop = stopCount;
+            const quint32 firstRule = ruleCount;
+
+            for (int s = 0; s < route->totalStops(); ++s) {
+                appendValue<quint32>(stopRecords, route->stopId(s));
+                appendValue<quint32>(stopRecords, strings.intern(route->stopCity(s)));
+                appendValue<qint32>(stopRecords, route->stopDuration(s));
+                appendDouble(stopRecords, route->stopPrice(s));
+                ++stopCount;
+            }
+
+            // Правила хранятся текстом в таблице строк: одинаковые правила разных маршрутов разделяют строку
+            for (const TripRule &rule : route->tripRules()) {
+                appendValue<quint32>(ruleRecords, strings.intern(QString::fromLatin1(rule.format())));
+                ++ruleCount;
+            }
+
+            appendValue<quint32>(routeRecords, route->id());
+            appendValue<quint32>(routeRecords, strings.intern(route->name()));
+            appendValue<quint32>(routeRecords, firstStop);
+            appendValue<quint32>(routeRecords, stopCount - firstStop);
+            appendValue<quint32>(routeRecords, static_cast<quint32>(tripStream.size()));
+            appendValue<quint32>(routeRecords, static_cast<quint32>(departures.size()));
+            appendValue<quint32>(routeRecords, firstRule);
+            appendValue<quint32>(routeRecords, ruleCount - firstRule);
+
+            // Рейсы упорядочены по времени, а их id обычно идут подряд - обе дельты малы
+            qint64 previous = 0;
+            qint64 previousId = 0;
+            for (qsizetype t = 0; t < departures.size(); ++t) {
+                appendVarint(tripStream, departures[t] - previous);
+                appendVarint(tripStream, qint64(tripIds[t]) - previousId);
+                previous = departures[t];
+                previousId = tripIds[t];
+            }
+            tripCount += static_cast<quint32>(departures.size());
+            ++routeCount;
+        }
+    }
+
+    QByteArray body;
+    body.reserve((strings.count() + 1) * 4 + strings.pool().size() + companyRecords.size()
+                 + routeRecords.size() + stopRecords.size() + ruleRecords.size() + tripStream.size());
+    for (quint32 offset : strings.offsets()) {
+        appendValue<quint32>(body, offset);
+    }
+    appendValue<quint32>(body, static_cast<quint32>(strings.pool().size()));
+    body.append(strings.pool());
+    body.append(companyRecords);
+    body.append(routeRecords);
+    body.append(stopRecords);
+    body.append(ruleRecords);
+    body.append(tripStream);
+
+    QByteArray header;
+    header.append(MAGIC.data(), qsizetype(MAGIC.size()));
+    appendValue<quint32>(header, FORMAT_VERSION);
+    appendValue<quint32>(header, crc32(reinterpret_cast<const uchar *>(body.constData()), body.size()));
+    appendValue<quint32>(header, strings.count());
+    appendValue<quint32>(header, static_cast<quint32>(companies.size()));
+    appendValue<quint32>(header, routeCount);
+    appendValue<quint32>(header, stopCount);
+    appendValue<quint32>(header, tripCount);
+    appendValue<quint32>(header, static_cast<quint32>(strings.pool().size()));
+    appendValue<quint32>(header, static_cast<quint32>(tripStream.size()));
+    appendValue<quint32>(header, ruleCount);
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        throw DatabaseException(QString("Could not open snapshot file for writing: %1. Error: %2")
+                                    .arg(filePath).arg(file.errorString()));
+    }
+    if (file.write(header) != header.size() || file.write(body) != body.size() || !file.commit()) {
+        throw DatabaseException(QString("Failed to write snapshot file: %1. Error: %2")
+                                    .arg(filePath).arg(file.errorString()));
+    }
+}
+
+QVector<Company> BinarySnapshot::read(const QString& filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw DatabaseException(QString("Could not open snapshot file for reading: %1. Error: %2")
+                                    .arg(filePath).arg(file.errorString()));
+    }
+
+    const qint64 size = file.size();
+    if (size < HEADER_SIZE) {
+        throw DatabaseException("Corrupted binary snapshot: file is too small");
+    }
+
+    const uchar *data = file.map(0, size);
+    if (!data) {
+        throw DatabaseException(QString("Could not map snapshot file: %1").arg(file.errorString()));
+    }
+    const SnapshotReader reader(data, size);
+
+    if (std::memcmp(data, MAGIC.data(), MAGIC.size()) != 0) {
+        throw DatabaseException("Not a binary snapshot file");
+    }
+    if (const quint32 version = reader.u32(4); version != FORMAT_VERSION) {
+        throw DatabaseException(QString("Unsupported snapshot version: %1").arg(version));
+    }
+    if (crc32(data + HEADER_SIZE, size - HEADER_SIZE) != reader.u32(8)) {
+        throw DatabaseException("Corrupted binary snapshot: checksum mismatch");
+    }
+
+    const quint32 stringCount = reader.u32(12);
+    const quint32 companyCount = reader.u32(16);
+    const quint32 routeCount = reader.u32(20);
+    const quint32 stopCount = reader.u32(24);
+    const quint32 tripCount = reader.u32(28);
+    const quint32 poolSize = reader.u32(32);
+    const quint32 tripBytes = reader.u32(36);
+    const quint32 ruleCount = reader.u32(40);
+
+    const qint64 offsetsStart = HEADER_SIZE;
+    const qint64 poolStart = offsetsStart + (qint64(stringCount) + 1) * 4;
+    const qint64 companiesStart = poolStart + poolSize;
+    const qint64 routesStart = companiesStart + qint64(companyCount) * COMPANY_RECORD_SIZE;
+    const qint64 stopsStart = routesStart + qint64(routeCount) * ROUTE_RECORD_SIZE;
+    const qint64 rulesStart = stopsStart + qint64(stopCount) * STOP_RECORD_SIZE;
+    const qint64 tripsStart = rulesStart + qint64(ruleCount) * RULE_RECORD_SIZE;
+    if (tripsStart + tripBytes != size) {
+        throw DatabaseException("Corrupted binary snapshot: unexpected file size");
+    }
+
+    // Каждая строка декодируется один раз; одинаковые города разделяют один QString
+    QVector<QString> strings;
+    strings.reserve(stringCount);
+    for (quint32 i = 0; i < stringCount; ++i) {
+        const quint32 begin = reader.u32(offsetsStart + qint64(i) * 4);
+        const quint32 end = reader.u32(offsetsStart + (qint64(i) + 1) * 4);
+        if (begin > end || end > poolSize) {
+            throw DatabaseException("Corrupted binary snapshot: invalid string table");
+        }
+        strings.append(QString::fromUtf8(reader.bytes(poolStart + begin, end - begin)));
+    }
+
+    const auto string = [&strings](quint32 index) -> const QString& {
+        checkIndex(index, 1, strings.size(), "string");
+        return strings[index];
+    };
+
+    // Названия городов попадают в словарь по одному разу на строку таблицы
+    QVector<CityId> cityIds(strings.size(), CityDictionary::InvalidCityId);
+    const auto city = [&](quint32 index) {
+        const QString &name = string(index);
+        if (cityIds[index] == CityDictionary::InvalidCityId) {
+            cityIds[index] = CityDictionary::instance().intern(name);
+        }
+        return cityIds[index];
+    };
+
+    QVector<Company> companies;
+    companies.reserve(companyCount);
+    quint64 tripsRead = 0;
+
+    for (quint32 c = 0; c < companyCount; ++c) {
+        const qint64 record = companiesStart + qint64(c) * COMPANY_RECORD_SIZE;
+        const quint32 firstRoute = reader.u32(record + 8);
+        const quint32 companyRoutes = reader.u32(record + 12);
+        checkIndex(firstRoute, companyRoutes, routeCount, "route");
+
+        Company company(string(reader.u32(record + 4)));
+        company.setId(reader.u32(record));
+        for (quint32 r = firstRoute; r < firstRoute + companyRoutes; ++r) {
+            const qint64 routeRecord = routesStart + qint64(r) * ROUTE_RECORD_SIZE;
+            const quint32 firstStop = reader.u32(routeRecord + 8);
+            const quint32 routeStops = reader.u32(routeRecord + 12);
+            qint64 tripOffset = tripsStart + reader.u32(routeRecord + 16);
+            const quint32 routeTrips = reader.u32(routeRecord + 20);
+            const quint32 firstRule = reader.u32(routeRecord + 24);
+            const quint32 routeRules = reader.u32(routeRecord + 28);
+            checkIndex(firstStop, routeStops, stopCount, "stop");
+            checkIndex(firstRule, routeRules, ruleCount, "trip rule");
+
+            auto route = std::make_shared<Route>(string(reader.u32(routeRecord + 4)));
+            route->setId(reader.u32(routeRecord));
+            for (quint32 s = firstStop; s < firstStop + routeStops; ++s) {
+                const qint64 stopRecord = stopsStart + qint64(s) * STOP_RECORD_SIZE;
+                route->addStop(city(reader.u32(stopRecord + 4)), reader.i32(stopRecord + 8), reader.f64(stopRecord + 12),
+                               reader.u32(stopRecord));
+            }
+
+            qint64 minutes = 0;
+            qint64 id = 0;
+            for (quint32 t = 0; t < routeTrips; ++t) {
+                minutes += reader.varint(tripOffset, size);
+                id += reader.varint(tripOffset, size);
+                if (minutes <= Trip::INVALID_MINUTES || minutes > std::numeric_limits<qint32>::max()) {
+                    throw DatabaseException("Corrupted binary snapshot: trip time out of range");
+                }
+                route->addTrip(static_cast<qint32>(minutes), static_cast<quint32>(id));
+            }
+            tripsRead += routeTrips;
+
+            for (quint32 p = firstRule; p < firstRule + routeRules; ++p) {
+                TripRule rule;
+                if (!TripRule::parse(string(reader.u32(rulesStart + qint64(p) * RULE_RECORD_SIZE)).toLatin1(), rule)) {
+                    throw DatabaseException("Corrupted binary snapshot: invalid trip rule");
+                }
+                route->addTripRule(rule);
+            }
+            company.addRoute(route);
+        }
+        companies.append(std::move(company));
+    }
+
+    if (tripsRead != tripCount) {
+        throw DatabaseException("Corrupted binary snapshot: trip count mismatch");
+    }
+
+    return companies;
+}
@@ -0,0 +1,478 @@
+#include "changejournal.h"
+#include "DatabaseException.h"
+#include "route.h"
+#include "trip.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QDebug>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::array<char, 4> MAGIC = {'B', 'S', 'J', 'L'};
+constexpr quint32 FORMAT_VERSION = 2;
+// Версия 1 не хранила идентификаторы; такой журнал еще читается
+constexpr quint32 FORMAT_VERSION_WITHOUT_IDS = 1;
+constexpr qint64 HEADER_SIZE = 24;
+constexpr qint64 RECORD_HEADER_SIZE = 6;
+
+QByteArray encodeHeader(const ChangeJournal::BaseStamp& base, quint32 version = FORMAT_VERSION) {
+    QByteArray header(HEADER_SIZE, '\0');
+    std::memcpy(header.data(), MAGIC.data(), MAGIC.size());
+    qToLittleEndian<quint32>(version, header.data() + 4);
+    qToLittleEndian<qint64>(base.size, header.data() + 8);
+    qToLittleEndian<qint64>(base.modifiedMsecs, header.data() + 16);
+    return header;
+}
+
+QByteArray encodeEntry(const JournalEntry& entry) {
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << static_cast<quint8>(entry.type) << entry.company << entry.route << entry.position
+        << entry.name << entry.durationMinutes << entry.price << entry.departure << entry.id;
+
+    QByteArray record(RECORD_HEADER_SIZE, '\0');
+    qToLittleEndian<quint32>(static_cast<quint32>(payload.size()), record.data());
+    qToLittleEndian<quint16>(qChecksum(payload), record.data() + 4);
+    record.append(payload);
+    return record;
+}
+
+// flush() лишь передает данные системе; запись переживает сбой питания только после сброса на диск
+bool syncToDisk(QFile& file) {
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return ::_commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+bool decodeEntry(const QByteArray& payload, quint32 version, JournalEntry& entry) {
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint8 type = 0;
+    in >> type >> entry.company >> entry.route >> entry.position
+        >> entry.name >> entry.durationMinutes >> entry.price >> entry.departure;
+    if (version != FORMAT_VERSION_WITHOUT_IDS) {
+        in >> entry.id;
+    }
+    entry.type = static_cast<JournalEntry::Type>(type);
+    return in.status() == QDataStream::Ok && type <= static_cast<quint8>(JournalEntry::Type::RemoveTripRule);
+}
+
+bool sameRoute(const std::shared_ptr<const Route>& a, const std::shared_ptr<const Route>& b) {
+    if (a == b || a->sharesDataWith(*b)) return true;
+    if (a->id() != b->id() || a->name() != b->name() || a->tripCount() != b->tripCount()) return false;
+
+    return a->stopIds() == b->stopIds() && a->stopCityIds() == b->stopCityIds()
+        && a->stopDurations() == b->stopDurations() && a->stopPrices() == b->stopPrices()
+        && a->tripDepartures() == b->tripDepartures() && a->tripIds() == b->tripIds()
+        && a->tripRules() == b->tripRules();
+}
+
+bool sameCompany(const Company& a, const Company& b) {
+    return a.id() == b.id() && a.name() == b.name() && std::ranges::equal(a.routes(), b.routes(), sameRoute);
+}
+
+// Те же сущности на тех же местах - изменения можно описать правкой на месте
+template<typename Sequence, typename IdOf>
+bool sameIds(const Sequence& before, const Sequence& after, IdOf idOf) {
+    return std::ranges::equal(before, after, [&idOf](const auto& a, const auto& b) { return idOf(a) == idOf(b); });
+}
+
+// Длины совпадающих начала и конца двух последовательностей длиной sizeBefore и sizeAfter;
+// equalAt(i, j) сравнивает i-й элемент первой с j-м элементом второй
+template<typename EqualAt>
+std::pair<qsizetype, qsizetype> commonEnds(qsizetype sizeBefore, qsizetype sizeAfter, EqualAt equalAt) {
+    const qsizetype limit = std::min(sizeBefore, sizeAfter);
+    qsizetype prefix = 0;
+    while (prefix < limit && equalAt(prefix, prefix)) {
+        ++prefix;
+    }
+    qsizetype suffix = 0;
+    while (suffix < limit - prefix && equalAt(sizeBefore - 1 - suffix, sizeAfter - 1 - suffix)) {
+        ++suffix;
+    }
+    return {prefix, suffix};
+}
+
+template<typename Sequence, typename Equal>
+std::pair<qsizetype, qsizetype> commonEnds(const Sequence& before, const Sequence& after, Equal equal) {
+    return commonEnds(before.size(), after.size(),
+                      [&](qsizetype i, qsizetype j) { return equal(before[i], after[j]); });
+}
+
+bool sameStopAt(const Route& a, qsizetype i, const Route& b, qsizetype j) {
+    return a.stopId(i) == b.stopId(j) && a.stopCityId(i) == b.stopCityId(j)
+        && a.stopDuration(i) == b.stopDuration(j) && a.stopPrice(i) == b.stopPrice(j);
+}
+
+JournalEntry makeEntry(JournalEntry::Type type, qsizetype company, qsizetype route = 0, qsizetype position = 0) {
+    JournalEntry entry;
+    entry.type = type;
+    entry.company = static_cast<qint32>(company);
+    entry.route = static_cast<qint32>(route);
+    entry.position = static_cast<qint32>(position);
+    return entry;
+}
+
+void appendStopEntry(QVector<JournalEntry>& out, qsizetype c, qsizetype r, qsizetype position,
+                     const Route& route, qsizetype stop) {
+    auto entry = makeEntry(JournalEntry::Type::InsertStop, c, r, position);
+    entry.id = route.stopId(stop);
+    entry.name = route.stopCity(stop);
+    entry.durationMinutes = route.stopDuration(stop);
+    entry.price = route.stopPrice(stop);
+    out.append(entry);
+}
+
+void appendTripEntry(QVector<JournalEntry>& out, qsizetype c, qsizetype r, qsizetype position,
+                     const Route& route, qsizetype trip) {
+    auto entry = makeEntry(JournalEntry::Type::AddTrip, c, r, position);
+    entry.id = route.tripId(trip);
+    entry.departure = Trip::toDateTime(route.tripDeparture(trip));
+    out.append(entry);
+}
+
+// Правила не имеют id и адресуются позицией в списке правил маршрута
+void appendTripRuleEntry(QVector<JournalEntry>& out, qsizetype c, qsizetype r, qsizetype position,
+                         const TripRule& rule) {
+    auto entry = makeEntry(JournalEntry::Type::InsertTripRule, c, r, position);
+    entry.name = QString::fromLatin1(rule.format());
+    out.append(entry);
+}
+
+void appendNewRoute(QVector<JournalEntry>& out, qsizetype c, qsizetype r, const Route& route) {
+    auto entry = makeEntry(JournalEntry::Type::AddRoute, c, r);
+    entry.id = route.id();
+    entry.name = route.name();
+    out.append(entry);
+
+    for (qsizetype s = 0; s < route.totalStops(); ++s) {
+        appendStopEntry(out, c, r, s, route, s);
+    }
+    for (qsizetype t = 0; t < route.tripCount(); ++t) {
+        appendTripEntry(out, c, r, t, route, t);
+    }
+    for (qsizetype p = 0; p < route.tripRules().size(); ++p) {
+        appendTripRuleEntry(out, c, r, p, route.tripRules()[p]);
+    }
+}
+
+void diffRoute(QVector<JournalEntry>& out, qsizetype c, qsizetype r, const Route& before, const Route& after) {
+    if (before.name() != after.name()) {
+        auto entry = makeEntry(JournalEntry::Type::RenameRoute, c, r);
+        entry.name = after.name();
+        out.append(entry);
+    }
+
+    const qsizetype stopsBefore = before.totalStops();
+    const qsizetype stopsAfter = after.totalStops();
+    const auto [stopPrefix, stopSuffix] = commonEnds(stopsBefore, stopsAfter, [&](qsizetype i, qsizetype j) {
+        return sameStopAt(before, i, after, j);
+    });
+    for (qsizetype i = stopsBefore - stopSuffix - 1; i >= stopPrefix; --i) {
+        out.append(makeEntry(JournalEntry::Type::RemoveStop, c, r, i));
+    }
+    for (qsizetype i = stopPrefix; i < stopsAfter - stopSuffix; ++i) {
+        appendStopEntry(out, c, r, i, after, i);
+    }
+
+    const qsizetype tripsBefore = before.tripCount();
+    const qsizetype tripsAfter = after.tripCount();
+    const auto [tripPrefix, tripSuffix] = commonEnds(tripsBefore, tripsAfter, [&](qsizetype i, qsizetype j) {
+        return before.tripId(i) == after.tripId(j) && before.tripDeparture(i) == after.tripDeparture(j);
+    });
+    // Удаляемый рейс помечается своим id: по нему запись применяется независимо от порядка рейсов
+    for (qsizetype i = tripsBefore - tripSuffix - 1; i >= tripPrefix; --i) {
+        auto entry = makeEntry(JournalEntry::Type::RemoveTrip, c, r, i);
+        entry.id = before.tripId(i);
+        out.append(entry);
+    }
+    for (qsizetype i = tripPrefix; i < tripsAfter - tripSuffix; ++i) {
+        appendTripEntry(out, c, r, i, after, i);
+    }
+
+    const auto &rulesBefore = before.tripRules();
+    const auto &rulesAfter = after.tripRules();
+    const auto [rulePrefix, ruleSuffix] = commonEnds(rulesBefore.size(), rulesAfter.size(), [&](qsizetype i, qsizetype j) {
+        return rulesBefore[i] == rulesAfter[j];
+    });
+    for (qsizetype i = rulesBefore.size() - ruleSuffix - 1; i >= rulePrefix; --i) {
+        out.append(makeEntry(JournalEntry::Type::RemoveTripRule, c, r, i));
+    }
+    for (qsizetype i = rulePrefix; i < rulesAfter.size() - ruleSuffix; ++i) {
+        appendTripRuleEntry(out, c, r, i, rulesAfter[i]);
+    }
+}
+
+void diffCompany(QVector<JournalEntry>& out, qsizetype c, const Company& before, const Company& after) {
+    if (before.name() != after.name()) {
+        auto entry = makeEntry(JournalEntry::Type::RenameCompany, c);
+        entry.name = after.name();
+        out.append(entry);
+    }
+
+    const auto &routesBefore = before.routes();
+    const auto &routesAfter = after.routes();
+
+    // Те же маршруты в том же порядке - правка на месте, сравниваем попарно
+    if (sameIds(routesBefore, routesAfter, [](const auto& route) { return route->id(); })) {
+        for (qsizetype r = 0; r < routesAfter.size(); ++r) {
+            if (!sameRoute(routesBefore[r], routesAfter[r])) {
+                diffRoute(out, c, r, *routesBefore[r], *routesAfter[r]);
+            }
+        }
+        return;
+    }
+
+    const auto [prefix, suffix] = commonEnds(routesBefore, routesAfter, sameRoute);
+    for (qsizetype r = routesBefore.size() - suffix - 1; r >= prefix; --r) {
+        out.append(makeEntry(JournalEntry::Type::RemoveRoute, c, r));
+    }
+    for (qsizetype r = prefix; r < routesAfter.size() - suffix; ++r) {
+        appendNewRoute(out, c, r, *routesAfter[r]);
+    }
+}
+
+} // namespace
+
+ChangeJournal::ChangeJournal(const QString &filePath) : m_filePath(filePath) {}
+
+ChangeJournal::BaseStamp ChangeJournal::stampOf(const QString &baseFilePath) {
+    const QFileInfo info(baseFilePath);
+    if (!info.exists()) {
+        return {};
+    }
+    return {info.size(), info.lastModified().toMSecsSinceEpoch()};
+}
+
+QVector<JournalEntry> ChangeJournal::diff(const QVector<Company>& before, const QVector<Company>& after) {
+    QVector<JournalEntry> entries;
+
+    if (sameIds(before, after, [](const Company& company) { return company.id(); })) {
+        for (qsizetype c = 0; c < after.size(); ++c) {
+            diffCompany(entries, c, before[c], after[c]);
+        }
+        return entries;
+    }
+
+    const auto [prefix, suffix] = commonEnds(before, after, sameCompany);
+    for (qsizetype c = before.size() - suffix - 1; c >= prefix; --c) {
+        entries.append(makeEntry(JournalEntry::Type::RemoveCompany, c));
+    }
+    for (qsizetype c = prefix; c < after.size() - suffix; ++c) {
+        auto entry = makeEntry(JournalEntry::Type::AddCompany, c);
+        entry.id = after[c].id();
+        entry.name = after[c].name();
+        entries.append(entry);
+        for (qsizetype r = 0; r < after[c].routes().size(); ++r) {
+            appendNewRoute(entries, c, r, *after[c].routes()[r]);
+        }
+    }
+    return entries;
+}
+
+void ChangeJournal::apply(QVector<Company>& companies, const JournalEntry& entry) {
+    const auto checkIndex = [](qsizetype index, qsizetype size, const char *what) {
+        if (index < 0 || index >= size) {
+            throw DatabaseException(QString("Journal refers to missing %1 at index %2").arg(what).arg(index));
+        }
+    };
+    const auto company = [&]() -> Company& {
+        checkIndex(entry.company, companies.size(), "company");
+        return companies[entry.company];
+    };
+    const auto route = [&]() -> Route& {
+        auto &routes = company().mutableRoutes();
+        checkIndex(entry.route, routes.size(), "route");
+        return *routes[entry.route];
+    };
+
+    using enum JournalEntry::Type;
+
+    switch (entry.type) {
+    case AddCompany:
+        checkIndex(entry.company, companies.size() + 1, "company");
+        companies.insert(entry.company, Company(entry.name));
+        companies[entry.company].setId(entry.id);
+        break;
+    case RemoveCompany:
+        checkIndex(entry.company, companies.size(), "company");
+        companies.remove(entry.company);
+        break;
+    case RenameCompany:
+        company().setName(entry.name);
+        break;
+    case AddRoute: {
+        auto &routes = company().mutableRoutes();
+        checkIndex(entry.route, routes.size() + 1, "route");
+        routes.insert(entry.route, std::make_shared<Route>(entry.name));
+        routes[entry.route]->setId(entry.id);
+        break;
+    }
+    case RemoveRoute: {
+        auto &routes = company().mutableRoutes();
+        checkIndex(entry.route, routes.size(), "route");
+        routes.remove(entry.route);
+        break;
+    }
+    case RenameRoute:
+        route().setName(entry.name);
+        break;
+    case InsertStop:
+        route().insertStop(entry.position, entry.name, entry.durationMinutes, entry.price, entry.id);
+        break;
+    case RemoveStop:
+        route().removeStop(entry.position);
+        break;
+    case AddTrip: {
+        Route &target = route();
+        const qint32 departure = Trip::toMinutes(entry.departure);
+        checkIndex(entry.position, target.tripCount() + 1, "trip");
+        if (departure == Trip::INVALID_MINUTES) {
+            throw DatabaseException("Journal trip has invalid departure datetime");
+        }
+        // Журналы, записанные до упорядочивания рейсов, могут указывать место не по порядку
+        const auto &departures = target.tripDepartures();
+        const bool ordered = (entry.position == 0 || departures[entry.position - 1] <= departure)
+                             && (entry.position == target.tripCount() || departure <= departures[entry.position]);
+        if (ordered) {
+            target.insertTrip(entry.position, departure, entry.id);
+        } else {
+            target.addTrip(departure, entry.id);
+        }
+        break;
+    }
+    case RemoveTrip: {
+        Route &target = route();
+        qsizetype position = entry.position;
+        if (entry.id != 0) {
+            position = target.tripIds().indexOf(entry.id);
+            if (position < 0) {
+                throw DatabaseException(QString("Journal refers to missing trip id %1").arg(entry.id));
+            }
+        }
+        checkIndex(position, target.tripCount(), "trip");
+        target.removeTrip(static_cast<int>(position));
+        break;
+    }
+    case InsertTripRule: {
+        Route &target = route();
+        checkIndex(entry.position, target.tripRules().size() + 1, "trip rule");
+        TripRule rule;
+        if (!TripRule::parse(entry.name.toLatin1(), rule)) {
+            throw DatabaseException(QString("Journal has invalid trip rule: %1").arg(entry.name));
+        }
+        target.insertTripRule(entry.position, rule);
+        break;
+    }
+    case RemoveTripRule: {
+        Route &target = route();
+        checkIndex(entry.position, target.tripRules().size(), "trip rule");
+        target.removeTripRule(entry.position);
+        break;
+    }
+    }
+}
+
+bool ChangeJournal::matches(const BaseStamp& base) const {
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return file.read(HEADER_SIZE) == encodeHeader(base);
+}
+
+bool ChangeJournal::hasEntries(const BaseStamp& base) const {
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= HEADER_SIZE) {
+        return false;
+    }
+    const QByteArray header = file.read(HEADER_SIZE);
+    return header == encodeHeader(base) || header == encodeHeader(base, FORMAT_VERSION_WITHOUT_IDS);
+}
+
+QVector<JournalEntry> ChangeJournal::read(const BaseStamp& base) const {
+    QVector<JournalEntry> entries;
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entries;
+    }
+
+    const QByteArray header = file.read(HEADER_SIZE);
+    quint32 version = FORMAT_VERSION;
+    if (header == encodeHeader(base, FORMAT_VERSION_WITHOUT_IDS)) {
+        version = FORMAT_VERSION_WITHOUT_IDS;
+    } else if (header != encodeHeader(base)) {
+        qWarning() << "Journal does not belong to the current companies file, ignoring it:" << m_filePath;
+        return entries;
+    }
+
+    while (!file.atEnd()) {
+        const QByteArray recordHeader = file.read(RECORD_HEADER_SIZE);
+        if (recordHeader.size() != RECORD_HEADER_SIZE) {
+            qWarning() << "Journal ends with a truncated record, ignoring the tail";
+            break;
+        }
+        const auto length = qFromLittleEndian<quint32>(recordHeader.constData());
+        const auto checksum = qFromLittleEndian<quint16>(recordHeader.constData() + 4);
+        const QByteArray payload = file.read(length);
+
+        JournalEntry entry;
+        if (payload.size() != qsizetype(length) || qChecksum(payload) != checksum || !decodeEntry(payload, version, entry)) {
+            qWarning() << "Journal ends with a damaged record, ignoring the tail";
+            break;
+        }
+        entries.append(entry);
+    }
+    return entries;
+}
+
+void ChangeJournal::append(const QVector<JournalEntry>& entries) const {
+    if (entries.isEmpty()) {
+        return;
+    }
+
+    QByteArray records;
+    for (const auto &entry : entries) {
+        records.append(encodeEntry(entry));
+    }
+
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        throw DatabaseException(QString("Could not open journal for writing: %1. Error: %2")
+                                    .arg(m_filePath).arg(file.errorString()));
+    }
+    if (file.write(records) != records.size() || !syncToDisk(file)) {
+        throw DatabaseException(QString("Failed to append to journal: %1").arg(file.errorString()));
+    }
+}
+
+void ChangeJournal::reset(const BaseStamp& base) const {
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        throw DatabaseException(QString("Could not reset journal: %1. Error: %2")
+                                    .arg(m_filePath).arg(file.errorString()));
+    }
+    if (const QByteArray header = encodeHeader(base); file.write(header) != header.size() || !syncToDisk(file)) {
+        throw DatabaseException(QString("Failed to write journal header: %1").arg(file.errorString()));
+    }
+}
+
+qint64 ChangeJournal::size() const {
+    return QFileInfo(m_filePath).size();
+}
@@ -0,0 +1,51 @@
+#include "citydictionary.h"
+
+CityDictionary& CityDictionary::instance() {
+    static CityDictionary dictionary;
+    return dictionary;
+}
+
+CityId CityDictionary::intern(const QString& name) {
+    // Почти все обращения при загрузке - к уже известным городам, им хватает блокировки на чтение
+    {
+        QReadLocker locker(&m_lock);
+        if (auto it = m_ids.constFind(name); it != m_ids.constEnd()) {
+            return it.value();
+        }
+    }
+
+    QWriteLocker locker(&m_lock);
+    if (auto it = m_ids.constFind(name); it != m_ids.constEnd()) {
+        return it.value();
+    }
+    const auto id = static_cast<CityId>(m_names.size());
+    m_names.append(name);
+    m_ids.insert(name, id);
+    return id;
+}
+
+CityId CityDictionary::find(const QString& name) const {
+    QReadLocker locker(&m_lock);
+    return m_ids.value(name, InvalidCityId);
+}
+
+QString CityDictionary::name(CityId id) const {
+    QReadLocker locker(&m_lock);
+    return id < CityId(m_names.size()) ? m_names[id] : QString();
+}
+
+qsizetype CityDictionary::size() const {
+    QReadLocker locker(&m_lock);
+    return m_names.size();
+}
+
+QVector<CityId> CityDictionary::findContaining(const QString& text, Qt::CaseSensitivity cs) const {
+    QReadLocker locker(&m_lock);
+    QVector<CityId> ids;
+    for (qsizetype i = 0; i < m_names.size(); ++i) {
+        if (m_names[i].contains(text, cs)) {
+            ids.append(static_cast<CityId>(i));
+        }
+    }
+    return ids;
+}
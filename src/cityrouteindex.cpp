@@ -0,0 +1,203 @@
+#include "cityrouteindex.h"
+#include <algorithm>
+
+namespace {
+
+const QVector<CityRouteIndex::Posting> NO_POSTINGS;
+
+bool postingLess(const CityRouteIndex::Posting &a, const CityRouteIndex::Posting &b) {
+    return a.slot != b.slot ? a.slot < b.slot : a.position < b.position;
+}
+
+} // namespace
+
+CityRouteIndex::CityRouteIndex(const QVector<Company>& companies) {
+    sync(companies);
+}
+
+bool CityRouteIndex::sync(const QVector<Company>& companies) {
+    ++m_syncNumber;
+    m_touchedCities.clear();
+    m_touchedSlots.clear();
+    qint64 order = 0;
+    bool changed = false;
+
+    for (const auto &company : companies) {
+        for (const auto &route : company.routes()) {
+            const qint32 slot = slotFor(route);
+            Slot &entry = m_slots[slot];
+            if (!entry.route || entry.revision != route->revision()) {
+                // Правка рейсов или цен не трогает списки остановок
+                if (!entry.route || entry.cities != route->stopCityIds()) {
+                    unindexSlot(slot);
+                    m_slots[slot].cities = route->stopCityIds();
+                    indexSlot(slot);
+                }
+                m_slots[slot].revision = route->revision();
+                m_touchedSlots.append(slot);
+                changed = true;
+            }
+            // Ответы, выданные раньше, ссылаются на прежний объект маршрута
+            changed = changed || m_slots[slot].order != order || m_slots[slot].route != route;
+            m_slots[slot].route = route;
+            m_slots[slot].order = order++;
+            m_slots[slot].seen = m_syncNumber;
+        }
+    }
+
+    // Маршруты, которых больше нет в компаниях
+    for (qint32 slot = 0; slot < m_slots.size(); ++slot) {
+        if (m_slots[slot].used && m_slots[slot].seen != m_syncNumber) {
+            releaseSlot(slot);
+            m_touchedSlots.append(slot);
+            changed = true;
+        }
+    }
+
+    std::sort(m_touchedCities.begin(), m_touchedCities.end());
+    m_touchedCities.erase(std::unique(m_touchedCities.begin(), m_touchedCities.end()), m_touchedCities.end());
+    std::sort(m_touchedSlots.begin(), m_touchedSlots.end());
+    m_touchedSlots.erase(std::unique(m_touchedSlots.begin(), m_touchedSlots.end()), m_touchedSlots.end());
+    return changed;
+}
+
+qint32 CityRouteIndex::slotFor(const std::shared_ptr<const Route>& route) {
+    const quint32 id = route->id();
+    qint32 slot = id != 0 ? m_slotById.value(id, -1) : m_slotByRoute.value(route.get(), -1);
+    // Повторный id в одной версии получает отдельное место
+    if (slot >= 0 && m_slots[slot].seen != m_syncNumber) {
+        return slot;
+    }
+
+    if (!m_freeSlots.isEmpty()) {
+        slot = m_freeSlots.takeLast();
+    } else {
+        slot = static_cast<qint32>(m_slots.size());
+        m_slots.append(Slot());
+    }
+    m_slots[slot].used = true;
+    m_slots[slot].id = id;
+    if (id != 0) {
+        m_slotById.insert(id, slot);
+    } else {
+        m_slotByRoute.insert(route.get(), slot);
+    }
+    return slot;
+}
+
+void CityRouteIndex::releaseSlot(qint32 slot) {
+    unindexSlot(slot);
+    Slot &entry = m_slots[slot];
+    if (entry.id != 0) {
+        if (m_slotById.value(entry.id, -1) == slot) {
+            m_slotById.remove(entry.id);
+        }
+    } else if (m_slotByRoute.value(entry.route.get(), -1) == slot) {
+        m_slotByRoute.remove(entry.route.get());
+    }
+    entry = Slot();
+    m_freeSlots.append(slot);
+}
+
+void CityRouteIndex::indexSlot(qint32 slot) {
+    const auto &cities = m_slots[slot].cities;
+    for (qint32 position = 0; position < cities.size(); ++position) {
+        auto &list = m_postings[cities[position]];
+        const Posting posting{slot, position};
+        list.insert(std::upper_bound(list.begin(), list.end(), posting, postingLess), posting);
+        m_touchedCities.append(cities[position]);
+    }
+}
+
+void CityRouteIndex::unindexSlot(qint32 slot) {
+    if (!m_slots[slot].route) {
+        return;
+    }
+    for (CityId city : m_slots[slot].cities) {
+        m_touchedCities.append(city);
+        auto it = m_postings.find(city);
+        if (it == m_postings.end()) {
+            continue;
+        }
+        auto &list = it.value();
+        const auto [first, last] = std::equal_range(list.begin(), list.end(), Posting{slot, -1},
+                                                    [](const Posting &a, const Posting &b) { return a.slot < b.slot; });
+        list.erase(first, last);
+        if (list.isEmpty()) {
+            m_postings.erase(it);
+        }
+    }
+}
+
+template<typename Visit>
+void CityRouteIndex::forEachRouteBetween(CityId from, CityId to, Visit visit) const {
+    const auto &fromList = postings(from);
+    const auto &toList = postings(to);
+
+    // Оба списка упорядочены по маршруту: общие маршруты находятся слиянием
+    auto a = fromList.begin();
+    auto b = toList.begin();
+    while (a != fromList.end() && b != toList.end()) {
+        if (a->slot < b->slot) {
+            ++a;
+        } else if (b->slot < a->slot) {
+            ++b;
+        } else {
+            const qint32 slot = a->slot;
+            const qint32 firstFrom = a->position;
+            qint32 lastTo = b->position;
+            while (a != fromList.end() && a->slot == slot) ++a;
+            while (b != toList.end() && b->slot == slot) lastTo = (b++)->position;
+            if (firstFrom < lastTo && !visit(slot)) {
+                return;
+            }
+        }
+    }
+}
+
+void CityRouteIndex::slotsBetween(CityId from, CityId to, QVector<qint32>& found) const {
+    found.clear();
+    forEachRouteBetween(from, to, [&found](qint32 slot) {
+        found.append(slot);
+        return true;
+    });
+    std::sort(found.begin(), found.end(), [this](qint32 a, qint32 b) {
+        return m_slots[a].order < m_slots[b].order;
+    });
+}
+
+QVector<std::shared_ptr<const Route>> CityRouteIndex::routesOf(QVector<qint32>& found) const {
+    std::sort(found.begin(), found.end(), [this](qint32 a, qint32 b) {
+        return m_slots[a].order < m_slots[b].order;
+    });
+
+    QVector<std::shared_ptr<const Route>> result;
+    result.reserve(found.size());
+    for (qint32 slot : found) {
+        result.append(m_slots[slot].route);
+    }
+    return result;
+}
+
+QVector<std::shared_ptr<const Route>> CityRouteIndex::routesBetween(CityId from, CityId to) const {
+    QVector<qint32> found;
+    forEachRouteBetween(from, to, [&found](qint32 slot) {
+        found.append(slot);
+        return true;
+    });
+    return routesOf(found);
+}
+
+bool CityRouteIndex::hasRouteBetween(CityId from, CityId to) const {
+    bool found = false;
+    forEachRouteBetween(from, to, [&found](qint32) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+const QVector<CityRouteIndex::Posting>& CityRouteIndex::postings(CityId city) const {
+    const auto it = m_postings.constFind(city);
+    return it != m_postings.constEnd() ? it.value() : NO_POSTINGS;
+}
@@ -1,61 +1,51 @@
 #include "company.h"
 #include "route.h"
 
-Company::Company(const QString &name) : m_name(name) {}
-
-Company::~Company() {
-    m_routes.clear();
-
-    m_name.clear();
-}
+class CompanyData : public QSharedData {
+public:
+    CompanyData() = default;
+
+    CompanyData(const CompanyData& other)
+        : QSharedData(other), m_id(other.m_id), m_name(other.m_name) {
+        // Новые указатели на те же данные маршрутов: изменение маршрута в одной
+        // компании отделит только его, не затрагивая другую
+        m_routes.reserve(other.m_routes.size());
+        for (const auto& route : other.m_routes) {
+            m_routes.append(std::make_shared<Route>(*route));
+        }
+    }
 
+    quint32 m_id = 0;
+    QString m_name;
+    QVector<std::shared_ptr<Route>> m_routes;
+};
 
-Company::Company(const Company& other) : m_name(other.m_name) {
-    for (const auto& route : other.m_routes) {
-        m_routes.append(std::make_shared<Route>(*route));
-    }
+Company::Company(const QString &name) : d(new CompanyData) {
+    d->m_name = name;
 }
 
-Company::Company(Company&& other) noexcept
-    : m_name(std::move(other.m_name)),
-    m_routes(std::move(other.m_routes)) {
+Company::~Company() = default;
 
-    other.m_name.clear();
-}
+Company::Company(const Company& other) = default;
 
-Company& Company::operator=(const Company& other) {
-    if (this != &other) {
-        m_name = other.m_name;
-        m_routes.clear();
-        for (const auto& route : other.m_routes) {
-            m_routes.append(std::make_shared<Route>(*route));
-        }
-    }
-    return *this;
-}
+Company& Company::operator=(const Company& other) = default;
 
-Company& Company::operator=(Company&& other) noexcept {
-    if (this != &other) {
-        m_name = std::move(other.m_name);
-        m_routes = std::move(other.m_routes);
+quint32 Company::id() const { return d->m_id; }
 
-        other.m_name.clear();
-    }
-    return *this;
-}
+void Company::setId(quint32 id) { d->m_id = id; }
 
-QString Company::name() const { return m_name; }
+QString Company::name() const { return d->m_name; }
 
-void Company::setName(const QString &name) { m_name = name; }
+void Company::setName(const QString &name) { d->m_name = name; }
 
 void Company::addRoute(std::shared_ptr<Route> route) {
-    m_routes.append(route);
+    d->m_routes.append(route);
 }
 
-QVector<std::shared_ptr<Route>>& Company::routes() {
-    return m_routes;
+RouteList Company::routes() const {
+    return RouteList(d->m_routes);
 }
 
-const QVector<std::shared_ptr<Route>>& Company::routes() const {
-    return m_routes;
+QVector<std::shared_ptr<Route>>& Company::mutableRoutes() {
+    return d->m_routes;
 }
@@ -0,0 +1,234 @@
+#include "connectionscan.h"
+#include "route.h"
+#include <algorithm>
+#include <limits>
+
+ConnectionScan::ConnectionScan(const QVector<Company>& companies, qint32 fromMinutes, qint32 toMinutes)
+    : m_fromMinutes(fromMinutes), m_toMinutes(toMinutes)
+{
+    for (const auto &company : companies) {
+        for (const auto &source : company.routes()) {
+            const qint32 routeIndex = static_cast<qint32>(m_routes.size());
+            // Копия разделяет данные с маршрутом, но не меняется вместе с ним
+            m_routes.append(std::make_shared<Route>(*source));
+            const Route &route = *m_routes.last();
+            const auto &cities = route.stopCityIds();
+            const auto &offsets = route.arrivalOffsets();
+
+            // Рейс, вышедший раньше окна, может быть в пути в его начале: окно рейсов сдвигается
+            // на длительность маршрута, а связи отбираются по собственному времени отправления
+            const qint32 tripsFrom = static_cast<qint32>(std::max<qint64>(qint64(fromMinutes) - route.totalDuration(),
+                                                                          std::numeric_limits<qint32>::min() + 1));
+            for (const Trip &trip : route.trips(tripsFrom, toMinutes)) {
+                qint32 tripIndex = -1;
+                for (qint32 position = 0; position + 1 < cities.size(); ++position) {
+                    const qint64 departure = qint64(trip.departureMinutes()) + offsets[position];
+                    const qint64 arrival = qint64(trip.departureMinutes()) + offsets[position + 1];
+                    if (departure >= toMinutes || arrival >= UNREACHED) {
+                        break;
+                    }
+                    if (departure < fromMinutes) {
+                        continue;
+                    }
+                    if (tripIndex < 0) {
+                        tripIndex = static_cast<qint32>(m_trips.size());
+                        m_trips.append({routeIndex, trip.departureMinutes(), trip.id()});
+                    }
+                    m_connections.append({cities[position], cities[position + 1], static_cast<qint32>(departure),
+                                          static_cast<qint32>(arrival), tripIndex, position});
+                }
+            }
+        }
+    }
+
+    // При равном отправлении связи одного рейса идут по порядку остановок (нулевые длительности)
+    std::stable_sort(m_connections.begin(), m_connections.end(), [](const Connection &a, const Connection &b) {
+        return a.departure < b.departure;
+    });
+}
+
+void ConnectionScan::scan(CityId from, CityId target, qint32 departAfter, int minTransferMinutes,
+                          QVector<qint32> &arrivals, QVector<Arrival> *journeys) const {
+    qsizetype cityCount = CityDictionary::instance().size();
+    arrivals.fill(UNREACHED, cityCount);
+    if (journeys) {
+        journeys->fill(Arrival(), cityCount);
+    }
+    if (from >= cityCount) {
+        return;
+    }
+    arrivals[from] = departAfter;
+
+    if (m_boarded.size() != m_trips.size()) {
+        m_boarded.fill(-1, m_trips.size());
+    }
+    const qint32 transfer = std::max(minTransferMinutes, 0);
+
+    const auto first = std::lower_bound(m_connections.begin(), m_connections.end(), departAfter,
+                                        [](const Connection &c, qint32 time) { return c.departure < time; });
+    for (auto it = first; it != m_connections.end(); ++it) {
+        const Connection &connection = *it;
+        if (target != CityDictionary::InvalidCityId && target < cityCount && connection.departure >= arrivals[target]) {
+            break;
+        }
+        if (connection.from >= cityCount || connection.to >= cityCount) {
+            continue;
+        }
+
+        qint32 &board = m_boarded[connection.trip];
+        if (board < 0) {
+            // Пересадка требует запаса времени; в городе отправления пассажир уже на месте
+            const qint32 reached = arrivals[connection.from];
+            const qint64 ready = connection.from == from ? reached : qint64(reached) + transfer;
+            if (reached == UNREACHED || ready > connection.departure) {
+                continue;
+            }
+            board = static_cast<qint32>(it - m_connections.begin());
+            m_boardedTrips.append(connection.trip);
+        }
+
+        if (connection.arrival < arrivals[connection.to]) {
+            arrivals[connection.to] = connection.arrival;
+            if (journeys) {
+                (*journeys)[connection.to] = {board, static_cast<qint32>(it - m_connections.begin())};
+            }
+        }
+    }
+
+    // Буфер возвращается в исходное состояние за время, пропорциональное числу посадок
+    for (qint32 trip : std::as_const(m_boardedTrips)) {
+        m_boarded[trip] = -1;
+    }
+    m_boardedTrips.clear();
+}
+
+Journey ConnectionScan::earliestArrival(CityId from, CityId to, qint32 departAfter, int minTransferMinutes) const {
+    Journey journey;
+    if (from == to) {
+        return journey;
+    }
+
+    QVector<qint32> arrivals;
+    QVector<Arrival> lastLegs;
+    scan(from, to, departAfter, minTransferMinutes, arrivals, &lastLegs);
+    if (to >= arrivals.size() || arrivals[to] == UNREACHED) {
+        return journey;
+    }
+
+    // Поездка восстанавливается от города прибытия по последним участкам
+    for (CityId city = to; city != from;) {
+        const Arrival &last = lastLegs[city];
+        journey.legs.prepend(legOf(last.boardConnection, last.alightConnection));
+        city = m_connections[last.boardConnection].from;
+    }
+    return journey;
+}
+
+JourneyLeg ConnectionScan::legOf(qint32 enter, qint32 exit) const {
+    const Connection &board = m_connections[enter];
+    const Connection &alight = m_connections[exit];
+    const TripInfo &trip = m_trips[board.trip];
+    const auto &route = m_routes[trip.route];
+
+    JourneyLeg leg;
+    leg.route = route;
+    leg.tripId = trip.id;
+    leg.tripDeparture = trip.departure;
+    leg.boardStop = board.position;
+    leg.alightStop = alight.position + 1;
+    leg.departure = board.departure;
+    leg.arrival = alight.arrival;
+    leg.price = route->segmentPrice(leg.boardStop + 1, leg.alightStop + 1);
+    return leg;
+}
+
+const ConnectionScan::ProfileEntry* ConnectionScan::entryAfter(const QVector<ProfileEntry> &entries, qint64 time) {
+    // Варианты добавляются по убыванию отправления: нужен последний с отправлением не раньше time
+    const auto it = std::partition_point(entries.begin(), entries.end(), [time](const ProfileEntry &entry) {
+        return entry.departure >= time;
+    });
+    return it == entries.begin() ? nullptr : &*(it - 1);
+}
+
+QVector<Journey> ConnectionScan::profile(CityId from, CityId to, qint32 windowStart, qint32 windowEnd,
+                                         int minTransferMinutes) const {
+    QVector<Journey> result;
+    const qsizetype cityCount = CityDictionary::instance().size();
+    if (from == to || from >= cityCount || to >= cityCount || windowStart > windowEnd) {
+        return result;
+    }
+    const qint32 transfer = std::max(minTransferMinutes, 0);
+
+    // Для каждого города - варианты доехать до to, для каждого рейса - лучшая высадка с него
+    QVector<QVector<ProfileEntry>> entries(cityCount);
+    QVector<ProfileEntry> seated(m_trips.size());
+
+    const auto first = std::lower_bound(m_connections.begin(), m_connections.end(), windowStart,
+                                        [](const Connection &c, qint32 time) { return c.departure < time; });
+    // Обратный проход: при обработке связи известны все варианты с более поздним отправлением
+    for (auto it = m_connections.end(); it != first;) {
+        --it;
+        const Connection &connection = *it;
+        if (connection.from >= cityCount || connection.to >= cityCount || connection.from == to) {
+            continue;
+        }
+        const auto index = static_cast<qint32>(it - m_connections.begin());
+
+        // Выйти в to, остаться в рейсе или пересесть в городе прибытия связи
+        ProfileEntry best;
+        if (connection.to == to) {
+            best.arrival = connection.arrival;
+            best.exit = index;
+        }
+        if (const ProfileEntry &stay = seated[connection.trip]; stay.arrival < best.arrival) {
+            best.arrival = stay.arrival;
+            best.exit = stay.exit;
+        }
+        if (const ProfileEntry *next = entryAfter(entries[connection.to], qint64(connection.arrival) + transfer);
+            next && next->arrival < best.arrival) {
+            best.arrival = next->arrival;
+            best.exit = index;
+        }
+        if (best.arrival == UNREACHED) {
+            continue;
+        }
+
+        if (best.arrival < seated[connection.trip].arrival) {
+            seated[connection.trip] = best;
+        }
+
+        best.departure = connection.departure;
+        best.enter = index;
+        auto &departures = entries[connection.from];
+        if (!departures.isEmpty() && best.arrival >= departures.last().arrival) {
+            continue;
+        }
+        if (!departures.isEmpty() && departures.last().departure == best.departure) {
+            departures.last() = best;
+        } else {
+            departures.append(best);
+        }
+    }
+
+    // Варианты из from лежат по убыванию отправления; каждый разворачивается в поездку
+    const auto &options = entries[from];
+    for (qsizetype i = options.size() - 1; i >= 0; --i) {
+        if (options[i].departure > windowEnd) {
+            break;
+        }
+        Journey journey;
+        for (const ProfileEntry *entry = &options[i]; entry;) {
+            journey.legs.append(legOf(entry->enter, entry->exit));
+            const Connection &alight = m_connections[entry->exit];
+            entry = alight.to == to ? nullptr : entryAfter(entries[alight.to], qint64(alight.arrival) + transfer);
+        }
+        result.append(journey);
+    }
+    return result;
+}
+
+QVector<qint32> ConnectionScan::earliestArrivals(CityId from, qint32 departAfter, int minTransferMinutes) const {
+    QVector<qint32> arrivals;
+    scan(from, CityDictionary::InvalidCityId, departAfter, minTransferMinutes, arrivals, nullptr);
+    return arrivals;
+}
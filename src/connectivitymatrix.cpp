@@ -0,0 +1,141 @@
+#include "connectivitymatrix.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr qint32 BITS_PER_WORD = 64;
+
+qint32 wordsFor(qint32 cityCount) {
+    return (cityCount + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+bool testBit(const quint64 *row, CityId city) {
+    return (row[city / BITS_PER_WORD] >> (city % BITS_PER_WORD)) & 1u;
+}
+
+} // namespace
+
+void ConnectivityMatrix::update(const CityRouteIndex& index) {
+    if (index.syncNumber() == m_syncNumber) {
+        return;
+    }
+    if (index.syncNumber() != m_syncNumber + 1) {
+        rebuild(index);
+        return;
+    }
+
+    m_syncNumber = index.syncNumber();
+    const auto &touched = index.touchedCities();
+    const qint32 cityCount = static_cast<qint32>(CityDictionary::instance().size());
+    if (touched.isEmpty() && cityCount == m_cityCount) {
+        return;
+    }
+
+    resize(cityCount);
+    for (CityId city : touched) {
+        updateRow(index, city);
+    }
+    m_closure.clear();
+    m_closureComplete = false;
+}
+
+void ConnectivityMatrix::rebuild(const CityRouteIndex& index) {
+    m_syncNumber = index.syncNumber();
+    m_cityCount = 0;
+    m_stride = 0;
+    m_direct.clear();
+    resize(static_cast<qint32>(CityDictionary::instance().size()));
+    for (qint32 city = 0; city < m_cityCount; ++city) {
+        updateRow(index, static_cast<CityId>(city));
+    }
+    m_closure.clear();
+    m_closureComplete = false;
+}
+
+void ConnectivityMatrix::resize(qint32 cityCount) {
+    if (cityCount <= m_cityCount) {
+        return;
+    }
+
+    const qint32 stride = wordsFor(cityCount);
+    if (stride != m_stride) {
+        // Строки становятся шире: переносим их в новую раскладку
+        QVector<quint64> direct(qsizetype(cityCount) * stride, 0);
+        for (qint32 city = 0; city < m_cityCount; ++city) {
+            std::copy_n(directRow(static_cast<CityId>(city)), m_stride, direct.data() + qsizetype(city) * stride);
+        }
+        m_direct = std::move(direct);
+        m_stride = stride;
+    } else {
+        m_direct.resize(qsizetype(cityCount) * m_stride, 0);
+    }
+    m_cityCount = cityCount;
+}
+
+void ConnectivityMatrix::updateRow(const CityRouteIndex& index, CityId city) {
+    if (city >= static_cast<CityId>(m_cityCount)) {
+        return;
+    }
+
+    quint64 *row = m_direct.data() + qsizetype(city) * m_stride;
+    std::fill_n(row, m_stride, 0);
+    for (const auto &posting : index.postings(city)) {
+        const auto &cities = index.route(posting.slot)->stopCityIds();
+        for (qsizetype next = posting.position + 1; next < cities.size(); ++next) {
+            const CityId to = cities[next];
+            row[to / BITS_PER_WORD] |= quint64(1) << (to % BITS_PER_WORD);
+        }
+    }
+}
+
+const QVector<quint64>& ConnectivityMatrix::closure(int transfers) const {
+    while (m_closure.size() < transfers && !m_closureComplete) {
+        const QVector<quint64> &previous = m_closure.isEmpty() ? m_direct : m_closure.last();
+
+        // Уровень t: все, что достижимо за t - 1 пересадку, плюс один прямой переезд оттуда
+        QVector<quint64> next = previous;
+        quint64 *out = next.data();
+        for (qint32 city = 0; city < m_cityCount; ++city) {
+            const quint64 *in = previous.constData() + qsizetype(city) * m_stride;
+            quint64 *row = out + qsizetype(city) * m_stride;
+            for (qint32 word = 0; word < m_stride; ++word) {
+                for (quint64 bits = in[word]; bits != 0; bits &= bits - 1) {
+                    const CityId via = static_cast<CityId>(word * BITS_PER_WORD + std::countr_zero(bits));
+                    const quint64 *direct = directRow(via);
+                    for (qint32 k = 0; k < m_stride; ++k) {
+                        row[k] |= direct[k];
+                    }
+                }
+            }
+        }
+
+        if (next == previous) {
+            m_closureComplete = true;
+        } else {
+            m_closure.append(std::move(next));
+        }
+    }
+
+    if (m_closure.isEmpty()) {
+        return m_direct;
+    }
+    return m_closure[std::min<qsizetype>(transfers, m_closure.size()) - 1];
+}
+
+bool ConnectivityMatrix::hasDirect(CityId from, CityId to) const {
+    if (from >= static_cast<CityId>(m_cityCount) || to >= static_cast<CityId>(m_cityCount)) {
+        return false;
+    }
+    return testBit(directRow(from), to);
+}
+
+bool ConnectivityMatrix::isReachable(CityId from, CityId to, int maxTransfers) const {
+    if (maxTransfers <= 0) {
+        return hasDirect(from, to);
+    }
+    if (from >= static_cast<CityId>(m_cityCount) || to >= static_cast<CityId>(m_cityCount)) {
+        return false;
+    }
+    return testBit(closure(maxTransfers).constData() + qsizetype(from) * m_stride, to);
+}
@@ -2,6 +2,7 @@
 #include "route.h"
 #include "trip.h"
 #include "addstopdialog.h"
+#include "tripruledialog.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFormLayout>
@@ -39,14 +40,26 @@ EditRouteDialog::EditRouteDialog(Route &route, QWidget *parent)
     tableTrips->setSelectionMode(QAbstractItemView::SingleSelection);
     tableTrips->setEditTriggers(QAbstractItemView::NoEditTriggers);
 
+    // Таблица правил повторяющихся рейсов
+    tableTripRules = new QTableWidget(this);
+    tableTripRules->setColumnCount(2);
+    tableTripRules->setHorizontalHeaderLabels({"Правило", "Действия"});
+    tableTripRules->horizontalHeader()->setStretchLastSection(false);
+    tableTripRules->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tableTripRules->setSelectionMode(QAbstractItemView::SingleSelection);
+    tableTripRules->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
     // Кнопка добавления остановки над таблицей
     btnAddStop = new QPushButton("➕ Добавить остановку", this);
 
     // Кнопка добавления рейса над таблицей
     btnAddTrip = new QPushButton("➕ Добавить рейс", this);
 
+    btnAddTripRule = new QPushButton("➕ Добавить правило", this);
+
     connect(btnAddStop, &QPushButton::clicked, this, &EditRouteDialog::onAddStop);
     connect(btnAddTrip, &QPushButton::clicked, this, &EditRouteDialog::onAddTrip);
+    connect(btnAddTripRule, &QPushButton::clicked, this, &EditRouteDialog::onAddTripRule);
 
     auto *mainLayout = new QVBoxLayout(this);
 
@@ -65,6 +78,9 @@ EditRouteDialog::EditRouteDialog(Route &route, QWidget *parent)
     tripsLayout->addWidget(new QLabel("Рейсы:"));
     tripsLayout->addWidget(btnAddTrip);
     tripsLayout->addWidget(tableTrips);
+    tripsLayout->addWidget(new QLabel("Правила расписания:"));
+    tripsLayout->addWidget(btnAddTripRule);
+    tripsLayout->addWidget(tableTripRules);
 
     contentLayout->addLayout(stopsLayout, 1);
     contentLayout->addLayout(tripsLayout, 1);
@@ -81,6 +97,7 @@ EditRouteDialog::EditRouteDialog(Route &route, QWidget *parent)
 
     updateStopsTable();
     updateTripsTable();
+    updateTripRulesTable();
 
     setWindowTitle("Редактирование маршрута");
     setMinimumSize(1000, 600);
@@ -88,15 +105,13 @@ EditRouteDialog::EditRouteDialog(Route &route, QWidget *parent)
 
 void EditRouteDialog::updateStopsTable(){
     tableStops->setRowCount(0);
-    auto stops = m_route.getAllStops();
-    tableStops->setRowCount(stops.size());
+    tableStops->setRowCount(m_route.totalStops());
 
-    int i = 0;
-    for(const auto &stop : stops){
+    for(int i = 0; i < m_route.totalStops(); ++i){
 
-        tableStops->setItem(i, 0, new QTableWidgetItem(stop->city));
-        tableStops->setItem(i, 1, new QTableWidgetItem(QString::number(stop->durationMinutes) + " мин"));
-        tableStops->setItem(i, 2, new QTableWidgetItem(QString::number(stop->price, 'f', 2) + " руб"));
+        tableStops->setItem(i, 0, new QTableWidgetItem(m_route.stopCity(i)));
+        tableStops->setItem(i, 1, new QTableWidgetItem(QString::number(m_route.stopDuration(i)) + " мин"));
+        tableStops->setItem(i, 2, new QTableWidgetItem(QString::number(m_route.stopPrice(i), 'f', 2) + " руб"));
 
         // Создаем контейнер для кнопок остановки
         auto *buttonsWidget = new QWidget(this);
@@ -142,7 +157,6 @@ void EditRouteDialog::updateStopsTable(){
         buttonsLayout->addWidget(btnDown);
 
         tableStops->setCellWidget(i, 3, buttonsWidget);
-        ++i;
     }
 
     tableStops->resizeColumnsToContents();
@@ -152,13 +166,12 @@ void EditRouteDialog::updateStopsTable(){
 
 void EditRouteDialog::updateTripsTable(){
     tableTrips->setRowCount(0);
-    const auto &trips = m_route.trips();
-    tableTrips->setRowCount(trips.size());
+    tableTrips->setRowCount(m_route.tripCount());
 
-    for(int i = 0; i < trips.size(); ++i){
-        const auto &trip = trips[i];
-        tableTrips->setItem(i, 0, new QTableWidgetItem(trip->departure().toString("dd.MM.yyyy HH:mm")));
-        tableTrips->setItem(i, 1, new QTableWidgetItem(trip->arrival(m_route).toString("dd.MM.yyyy HH:mm")));
+    for(int i = 0; i < m_route.tripCount(); ++i){
+        const Trip trip = m_route.trip(i);
+        tableTrips->setItem(i, 0, new QTableWidgetItem(trip.departure().toString("dd.MM.yyyy HH:mm")));
+        tableTrips->setItem(i, 1, new QTableWidgetItem(trip.arrival(m_route).toString("dd.MM.yyyy HH:mm")));
 
         // Создаем контейнер для кнопок рейса
         auto *buttonsWidget = new QWidget(this);
@@ -202,6 +215,43 @@ void EditRouteDialog::updateTripsTable(){
     tableTrips->setColumnWidth(2, 3 * 25); // 3 кнопки по 25 пикселей
 }
 
+void EditRouteDialog::updateTripRulesTable(){
+    const auto &rules = m_route.tripRules();
+    tableTripRules->setRowCount(0);
+    tableTripRules->setRowCount(rules.size());
+
+    for(int i = 0; i < rules.size(); ++i){
+        tableTripRules->setItem(i, 0, new QTableWidgetItem(rules[i].description()));
+
+        auto *buttonsWidget = new QWidget(this);
+        auto *buttonsLayout = new QHBoxLayout(buttonsWidget);
+        buttonsLayout->setContentsMargins(0, 0, 0, 0);
+        buttonsLayout->setSpacing(0);
+
+        auto *btnEdit = new QPushButton("✏️", this);
+        btnEdit->setFixedSize(25, 25);
+        btnEdit->setToolTip("Редактировать правило");
+        connect(btnEdit, &QPushButton::clicked, this, [this, i]() {
+            onEditTripRule(i);
+        });
+
+        auto *btnRemove = new QPushButton("❌", this);
+        btnRemove->setFixedSize(25, 25);
+        btnRemove->setToolTip("Удалить правило");
+        connect(btnRemove, &QPushButton::clicked, this, [this, i]() {
+            onRemoveTripRule(i);
+        });
+
+        buttonsLayout->addWidget(btnEdit);
+        buttonsLayout->addWidget(btnRemove);
+
+        tableTripRules->setCellWidget(i, 1, buttonsWidget);
+    }
+
+    tableTripRules->resizeColumnsToContents();
+    tableTripRules->setColumnWidth(1, 2 * 25); // 2 кнопки по 25 пикселей
+}
+
 void EditRouteDialog::onAddStop(){
     AddStopDialog dlg(this);
     if(dlg.exec() == QDialog::Accepted){
@@ -219,7 +269,7 @@ void EditRouteDialog::onEditStop(int row){
 
         if(dlg.exec() == QDialog::Accepted){
             m_route.removeStop(row);
-            m_route.insertStop(row, dlg.cityName(), dlg.duration(), dlg.price());
+            m_route.insertStop(row, dlg.cityName(), dlg.duration(), dlg.price(), stop->id);
             updateStopsTable();
         }
     }
@@ -243,7 +293,7 @@ void EditRouteDialog::onMoveStopUp(int row){
     if(!stop) return;
 
     m_route.removeStop(row);
-    m_route.insertStop(row - 1, stop->city, stop->durationMinutes, stop->price);
+    m_route.insertStop(row - 1, stop->city, stop->durationMinutes, stop->price, stop->id);
     updateStopsTable();
     tableStops->setCurrentCell(row - 1, 0);
 }
@@ -255,7 +305,7 @@ void EditRouteDialog::onMoveStopDown(int row){
     if(!stop) return;
 
     m_route.removeStop(row);
-    m_route.insertStop(row + 1, stop->city, stop->durationMinutes, stop->price);
+    m_route.insertStop(row + 1, stop->city, stop->durationMinutes, stop->price, stop->id);
     updateStopsTable();
     tableStops->setCurrentCell(row + 1, 0);
 }
@@ -285,9 +335,9 @@ void EditRouteDialog::onAddTrip(){
 void EditRouteDialog::onEditTrip(int row){
     if(row < 0) return;
 
-    auto trip = m_route.trips()[row];
+    const Trip trip = m_route.trip(row);
 
-    auto *dtEdit = new QDateTimeEdit(trip->departure(), this);
+    auto *dtEdit = new QDateTimeEdit(trip.departure(), this);
     dtEdit->setDisplayFormat("dd.MM.yyyy HH:mm");
     dtEdit->setCalendarPopup(true);
 
@@ -303,8 +353,9 @@ void EditRouteDialog::onEditTrip(int row){
     layout->addWidget(buttons);
 
     if(dlg.exec() == QDialog::Accepted){
-        auto newTrip = std::make_shared<Trip>(dtEdit->dateTime());
-        m_route.trips()[row] = newTrip;
+        // Рейс с новым временем встает на свое место по порядку
+        m_route.removeTrip(row);
+        m_route.addTrip(dtEdit->dateTime(), trip.id());
         updateTripsTable();
     }
 }
@@ -312,8 +363,7 @@ void EditRouteDialog::onEditTrip(int row){
 void EditRouteDialog::onCopyTrip(int row){
     if(row < 0) return;
 
-    auto originalTrip = m_route.trips()[row];
-    m_route.addTrip(originalTrip->departure());
+    m_route.addTrip(m_route.tripDeparture(row));
     updateTripsTable();
 }
 
@@ -323,7 +373,37 @@ void EditRouteDialog::onRemoveTrip(int row){
     if(QMessageBox::question(this, "Подтверждение",
                               "Удалить выбранный рейс?",
                               QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes){
-        m_route.trips().remove(row);
+        m_route.removeTrip(row);
         updateTripsTable();
     }
 }
+
+void EditRouteDialog::onAddTripRule(){
+    TripRuleDialog dlg(this);
+    if(dlg.exec() == QDialog::Accepted){
+        m_route.addTripRule(dlg.rule());
+        updateTripRulesTable();
+    }
+}
+
+void EditRouteDialog::onEditTripRule(int row){
+    if(row < 0 || row >= m_route.tripRules().size()) return;
+
+    TripRuleDialog dlg(this);
+    dlg.setRule(m_route.tripRules()[row]);
+    if(dlg.exec() == QDialog::Accepted){
+        m_route.setTripRule(row, dlg.rule());
+        updateTripRulesTable();
+    }
+}
+
+void EditRouteDialog::onRemoveTripRule(int row){
+    if(row < 0) return;
+
+    if(QMessageBox::question(this, "Подтверждение",
+                              "Удалить выбранное правило расписания?",
+                              QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes){
+        m_route.removeTripRule(row);
+        updateTripRulesTable();
+    }
+}
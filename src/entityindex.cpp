@@ -0,0 +1,144 @@
+#include "entityindex.h"
+#include "route.h"
+#include "trip.h"
+#include <QSet>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Учет занятых идентификаторов одного вида сущностей
+class IdPool {
+public:
+    // false, если id не назначен или уже встречался
+    bool claim(quint32 id) {
+        m_max = std::max(m_max, id);
+        if (id == 0 || m_used.contains(id)) {
+            return false;
+        }
+        m_used.insert(id);
+        return true;
+    }
+
+    quint32 allocate() {
+        m_used.insert(++m_max);
+        return m_max;
+    }
+
+    void restart() {
+        m_used.clear();
+    }
+
+private:
+    QSet<quint32> m_used;
+    quint32 m_max = 0;
+};
+
+struct IdPools {
+    IdPool companies;
+    IdPool routes;
+    IdPool stops;
+    IdPool trips;
+
+    void restart() {
+        companies.restart();
+        routes.restart();
+        stops.restart();
+        trips.restart();
+    }
+};
+
+// Обходит все сущности и передает их id в claim; возвращает false, если хоть один не принят
+bool claimAll(const QVector<Company>& companies, IdPools& pools) {
+    bool complete = true;
+    for (const auto &company : companies) {
+        complete &= pools.companies.claim(company.id());
+        for (const auto &route : company.routes()) {
+            complete &= pools.routes.claim(route->id());
+            for (quint32 stopId : route->stopIds()) {
+                complete &= pools.stops.claim(stopId);
+            }
+            for (quint32 tripId : route->tripIds()) {
+                complete &= pools.trips.claim(tripId);
+            }
+        }
+    }
+    return complete;
+}
+
+} // namespace
+
+EntityIndex::EntityIndex(const QVector<Company>& companies) {
+    for (qsizetype c = 0; c < companies.size(); ++c) {
+        const Company &company = companies[c];
+        m_companies.insert(company.id(), {c, -1, -1});
+
+        for (qsizetype r = 0; r < company.routes().size(); ++r) {
+            const auto &route = company.routes()[r];
+            m_routes.insert(route->id(), {c, r, -1});
+
+            const auto &stopIds = route->stopIds();
+            for (qsizetype s = 0; s < stopIds.size(); ++s) {
+                m_stops.insert(stopIds[s], {c, r, s});
+            }
+
+            const auto &tripIds = route->tripIds();
+            for (qsizetype t = 0; t < tripIds.size(); ++t) {
+                m_trips.insert(tripIds[t], {c, r, t});
+            }
+        }
+    }
+}
+
+bool EntityIndex::assignIds(QVector<Company>& companies) {
+    // Первый проход только читает: если все id на месте, общие данные не копируются
+    IdPools pools;
+    if (claimAll(std::as_const(companies), pools)) {
+        return false;
+    }
+
+    // Новые id берутся выше максимального, поэтому не совпадут с уже выданными
+    pools.restart();
+    for (qsizetype c = 0; c < companies.size(); ++c) {
+        if (!pools.companies.claim(std::as_const(companies)[c].id())) {
+            companies[c].setId(pools.companies.allocate());
+        }
+
+        // Маршрут читается через константный доступ и отделяется, только когда в нем есть что менять
+        for (qsizetype r = 0; r < std::as_const(companies)[c].routes().size(); ++r) {
+            const auto route = [&]() -> const Route& { return *std::as_const(companies)[c].routes()[r]; };
+            const auto mutableRoute = [&]() -> Route& { return *companies[c].mutableRoutes()[r]; };
+
+            if (!pools.routes.claim(route().id())) {
+                mutableRoute().setId(pools.routes.allocate());
+            }
+            for (int s = 0; s < route().totalStops(); ++s) {
+                if (!pools.stops.claim(route().stopId(s))) {
+                    mutableRoute().setStopId(s, pools.stops.allocate());
+                }
+            }
+            for (int t = 0; t < route().tripCount(); ++t) {
+                if (!pools.trips.claim(route().tripId(t))) {
+                    mutableRoute().setTripId(t, pools.trips.allocate());
+                }
+            }
+        }
+    }
+    return true;
+}
+
+EntityLocation EntityIndex::company(quint32 id) const {
+    return m_companies.value(id);
+}
+
+EntityLocation EntityIndex::route(quint32 id) const {
+    return m_routes.value(id);
+}
+
+EntityLocation EntityIndex::stop(quint32 id) const {
+    return m_stops.value(id);
+}
+
+EntityLocation EntityIndex::trip(quint32 id) const {
+    return m_trips.value(id);
+}
@@ -1,25 +1,272 @@
 #include "filedatabase.h"
+#include "binarysnapshot.h"
+#include "entityindex.h"
 #include "DatabaseException.h"
 #include "ValidationException.h"
 #include <QFile>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QThreadPool>
 #include <QTextStream>
 #include <QDebug>
 #include <QStringConverter>
 #include <QDir>
+#include <QFileInfo>
 #include <QSet>
 #include <stdexcept>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <utility>
 #include "route.h"
 #include "trip.h"
 
+namespace {
+
+constexpr QByteArrayView utf8Bom("\xEF\xBB\xBF");
+
+// Длина пробельного символа (в смысле QChar::isSpace) в начале UTF-8 строки, 0 если его нет
+qsizetype leadingSpaceLength(QByteArrayView text) {
+    const auto byte = [&text](qsizetype i) { return static_cast<uchar>(text[i]); };
+
+    if (text.isEmpty()) return 0;
+    if (byte(0) == ' ' || (byte(0) >= '\t' && byte(0) <= '\r')) return 1;
+    if (text.size() >= 2 && byte(0) == 0xC2 && (byte(1) == 0x85 || byte(1) == 0xA0)) return 2;
+    if (text.size() < 3) return 0;
+    if (byte(0) == 0xE1 && byte(1) == 0x9A && byte(2) == 0x80) return 3;
+    if (byte(0) == 0xE2 && byte(1) == 0x80 && (byte(2) <= 0x8A || byte(2) == 0xA8 || byte(2) == 0xA9 || byte(2) == 0xAF)) return 3;
+    if (byte(0) == 0xE2 && byte(1) == 0x81 && byte(2) == 0x9F) return 3;
+    if (byte(0) == 0xE3 && byte(1) == 0x80 && byte(2) == 0x80) return 3;
+    return 0;
+}
+
+// То же для конца строки: пробельный символ занимает 1, 2 или 3 последних байта
+qsizetype trailingSpaceLength(QByteArrayView text) {
+    for (qsizetype length = 1; length <= 3 && length <= text.size(); ++length) {
+        if (leadingSpaceLength(text.last(length)) == length) return length;
+    }
+    return 0;
+}
+
+// Аналог QString::trimmed() для UTF-8 байтов без перекодирования строки
+QByteArrayView trimmedUtf8(QByteArrayView text) {
+    while (const qsizetype length = leadingSpaceLength(text)) text = text.sliced(length);
+    while (const qsizetype length = trailingSpaceLength(text)) text.chop(length);
+    return text;
+}
+
+// Разбирает начало строки "Tag: ..." или "Tag#id: ..." и возвращает в body текст после ": ".
+// false, если строка начинается с другого тега или идентификатор записан неверно
+bool splitTaggedLine(QByteArrayView line, QByteArrayView tag, quint32& id, QByteArrayView& body) {
+    if (!line.startsWith(tag)) return false;
+
+    QByteArrayView rest = line.sliced(tag.size());
+    id = 0;
+    if (rest.startsWith('#')) {
+        const qsizetype colon = rest.indexOf(':');
+        if (colon < 0) return false;
+        bool ok = false;
+        id = rest.sliced(1, colon - 1).toUInt(&ok);
+        if (!ok || id == 0) return false;
+        rest = rest.sliced(colon);
+    }
+
+    if (!rest.startsWith(": ")) return false;
+    body = rest.sliced(2);
+    return true;
+}
+
+// Пишет "Tag#id: " (или "Tag: ", если идентификатор еще не назначен)
+void writeTag(QTextStream& out, const char *tag, quint32 id) {
+    out << tag;
+    if (id != 0) {
+        out << '#' << id;
+    }
+    out << ": ";
+}
+
+// Файлы меньше этого размера разбираются в одном потоке
+constexpr qsizetype PARALLEL_PARSE_MIN_BYTES = 256 * 1024;
+
+// Участок файла из целых блоков компаний и номер его первой строки
+struct CompanyChunk {
+    QByteArrayView data;
+    int firstLine = 1;
+};
+
+// Режет файл по строкам "---" на куски примерно одинакового размера.
+// После разделителя состояние разбора сбрасывается, поэтому куски разбираются независимо
+QVector<CompanyChunk> splitAtSeparators(QByteArrayView data, int chunkCount) {
+    QVector<CompanyChunk> chunks;
+    const qsizetype targetSize = qMax<qsizetype>(data.size() / chunkCount, 1);
+
+    const char *const begin = data.data();
+    const char *const end = begin + data.size();
+    const char *chunkStart = begin;
+    const char *cursor = begin;
+    int lineNumber = 0;
+    int chunkFirstLine = 1;
+
+    while (cursor < end) {
+        const auto *newline = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+        const char *lineEnd = newline ? newline : end;
+        lineNumber++;
+
+        const bool separator = trimmedUtf8(QByteArrayView(cursor, lineEnd)) == "---";
+        cursor = newline ? newline + 1 : end;
+
+        if (separator && cursor - chunkStart >= targetSize) {
+            chunks.append({QByteArrayView(chunkStart, cursor), chunkFirstLine});
+            chunkStart = cursor;
+            chunkFirstLine = lineNumber + 1;
+        }
+    }
+
+    if (chunkStart < end) {
+        chunks.append({QByteArrayView(chunkStart, end), chunkFirstLine});
+    }
+    return chunks;
+}
+
+} // namespace
+
+// Получатель результатов разбора companies.txt.
+// По умолчанию маршруты и рейсы складываются в текущую компанию
+class FileDatabase::ParseSink {
+public:
+    virtual ~ParseSink() = default;
+
+    virtual void routeParsed(Company& company, const std::shared_ptr<Route>& route) {
+        company.addRoute(route);
+    }
+
+    virtual void tripParsed(const Company& company, Route& route, qint32 departureMinutes, quint32 id) {
+        Q_UNUSED(company);
+        route.addTrip(departureMinutes, id);
+    }
+
+    virtual void tripRuleParsed(const Company& company, Route& route, const TripRule& rule) {
+        Q_UNUSED(company);
+        route.addTripRule(rule);
+    }
+
+    // Компания разобрана целиком; после вызова парсер начинает новую
+    virtual void companyParsed(Company& company) = 0;
+};
+
+namespace {
+
+// Собирает все компании в список (обычная загрузка)
+class CompanyCollector : public FileDatabase::ParseSink {
+public:
+    explicit CompanyCollector(QVector<Company>& list) : m_list(list) {}
+
+    void companyParsed(Company& company) override {
+        m_list.append(std::move(company));
+    }
+
+private:
+    QVector<Company>& m_list;
+};
+
+// Отдает компании по одной, не накапливая их
+class CompanyVisitor : public FileDatabase::ParseSink {
+public:
+    explicit CompanyVisitor(const std::function<void(const Company&)>& visit) : m_visit(visit) {}
+
+    void companyParsed(Company& company) override {
+        m_visit(company);
+    }
+
+private:
+    const std::function<void(const Company&)>& m_visit;
+};
+
+// Отдает маршруты по одному; компания остается пустой оболочкой с именем
+class RouteVisitor : public FileDatabase::ParseSink {
+public:
+    explicit RouteVisitor(const std::function<void(const QString&, const Route&)>& visit) : m_visit(visit) {}
+
+    void routeParsed(Company& company, const std::shared_ptr<Route>& route) override {
+        // Маршруты до первой строки "Company:" при обычной загрузке отбрасываются
+        if (!company.name().isEmpty()) {
+            m_visit(company.name(), *route);
+        }
+    }
+
+    void companyParsed(Company& company) override {
+        Q_UNUSED(company);
+    }
+
+private:
+    const std::function<void(const QString&, const Route&)>& m_visit;
+};
+
+// Отдает рейсы по мере чтения, маршрут хранит только остановки
+class TripVisitor : public FileDatabase::ParseSink {
+public:
+    TripVisitor(qint32 fromMinutes, qint32 toMinutes, const std::function<void(const QString&, const Route&, const Trip&)>& visit)
+        : m_fromMinutes(fromMinutes), m_toMinutes(toMinutes), m_visit(visit) {}
+
+    void routeParsed(Company& company, const std::shared_ptr<Route>& route) override {
+        Q_UNUSED(company);
+        Q_UNUSED(route);
+    }
+
+    void tripParsed(const Company& company, Route& route, qint32 departureMinutes, quint32 id) override {
+        if (!company.name().isEmpty() && departureMinutes >= m_fromMinutes && departureMinutes < m_toMinutes) {
+            m_visit(company.name(), route, Trip::fromMinutes(departureMinutes, id));
+        }
+    }
+
+    void tripRuleParsed(const Company& company, Route& route, const TripRule& rule) override {
+        if (company.name().isEmpty()) {
+            return;
+        }
+        QVector<qint32> departures;
+        rule.expand(m_fromMinutes, m_toMinutes, departures);
+        for (qint32 departure : departures) {
+            m_visit(company.name(), route, Trip::fromMinutes(departure));
+        }
+    }
+
+    void companyParsed(Company& company) override {
+        Q_UNUSED(company);
+    }
+
+private:
+    qint32 m_fromMinutes;
+    qint32 m_toMinutes;
+    const std::function<void(const QString&, const Route&, const Trip&)>& m_visit;
+};
+
+} // namespace
+
 FileDatabase::FileDatabase(const QString &folderPath, QObject *parent)
-    : QObject(parent), m_folderPath(folderPath)
+    : QObject(parent), m_folderPath(folderPath), m_journal(journalFilePath())
 {
     m_autoSaveTimer = new QTimer(this);
     m_autoSaveTimer->setSingleShot(true);
     connect(m_autoSaveTimer, &QTimer::timeout, this, &FileDatabase::performAutoSave);
 
+    m_autoSaveWatcher = new QFutureWatcher<AutoSaveResult>(this);
+    connect(m_autoSaveWatcher, &QFutureWatcher<AutoSaveResult>::finished, this, &FileDatabase::onAutoSaveFinished);
+
+    bool missingIds = false;
     try {
-        m_companies = loadCompanies();
+        // Идентификаторы базе выдаются до применения журнала: его записи ссылаются на них.
+        // Для файла без id они выдаются по порядку строк и одинаковы при каждой загрузке
+        QVector<Company> base = loadBaseCompanies();
+        missingIds = EntityIndex::assignIds(base);
+        if (!base.isEmpty() && !isSnapshotFresh() && !missingIds) {
+            // Данные пришли из текстового файла - готовим снимок для следующего запуска.
+            // Для файла без id снимок появится после его перезаписи: свежий снимок означает,
+            // что в текстовом файле id уже есть и потоковый обход выдаст те же id
+            writeSnapshot(base);
+        }
+        m_companies = std::move(base);
+        replayJournal(m_companies);
+        missingIds |= EntityIndex::assignIds(m_companies);
         if (m_companies.isEmpty()) {
             m_companies.append(Company("Default Bus Co."));
         }
@@ -27,92 +274,364 @@ FileDatabase::FileDatabase(const QString &folderPath, QObject *parent)
         qWarning() << "Failed to load companies, creating default:" << e.what();
         m_companies.append(Company("Default Bus Co."));
     }
+
+    EntityIndex::assignIds(m_companies);
+
+    // Файл старого формата без идентификаторов переписываем, чтобы выданные id сохранились.
+    // Компания по умолчанию при ошибке загрузки файл не перезаписывает
+    if (missingIds) {
+        m_fullSaveRequired = true;
+        scheduleAutoSave();
+    }
+    m_index = EntityIndex(m_companies);
+}
+
+FileDatabase::~FileDatabase() {
+    m_autoSaveWatcher->waitForFinished();
+
+    // onAutoSaveFinished для последней записи уже не вызовется: ее правки взяты из m_pendingEntries,
+    // поэтому при ошибке файл переписывается целиком
+    const QFuture<AutoSaveResult> lastSave = m_autoSaveWatcher->future();
+    if (lastSave.isFinished() && lastSave.resultCount() > 0 && !lastSave.result().success) {
+        qCritical() << "Auto-save failed:" << lastSave.result().errorMessage;
+        m_fullSaveRequired = true;
+    }
+
+    // Отложенные таймером правки дописываем синхронно, чтобы не потерять их при выходе
+    if (m_autoSaveTimer->isActive() || m_autoSaveRequested || m_fullSaveRequired || !m_pendingEntries.isEmpty()) {
+        m_autoSaveTimer->stop();
+        const AutoSaveResult result = writeAutoSave(takeAutoSaveJob());
+        if (!result.success) {
+            qCritical() << "Final save failed:" << result.errorMessage;
+        }
+    }
 }
 
 QString FileDatabase::companiesFilePath() const {
     return m_folderPath + "/companies.txt";
 }
 
+QString FileDatabase::snapshotFilePath() const {
+    return m_folderPath + "/companies.bin";
+}
+
+QString FileDatabase::journalFilePath() const {
+    return m_folderPath + "/companies.journal";
+}
+
+bool FileDatabase::isSnapshotFresh() const {
+    const QFileInfo snapshot(snapshotFilePath());
+    if (!snapshot.exists()) {
+        return false;
+    }
+    const QFileInfo text(companiesFilePath());
+    return !text.exists() || snapshot.lastModified() >= text.lastModified();
+}
+
+void FileDatabase::writeSnapshot(const QVector<Company> &companies) const {
+    try {
+        BinarySnapshot::write(snapshotFilePath(), companies);
+    } catch (const DatabaseException& e) {
+        // Устаревший снимок не должен перекрыть свежий текстовый файл
+        qWarning() << "Failed to write binary snapshot:" << e.what();
+        QFile::remove(snapshotFilePath());
+    }
+}
+
 QVector<Company> FileDatabase::loadCompanies() const {
-    QVector<Company> list;
+    QVector<Company> list = loadBaseCompanies();
+    EntityIndex::assignIds(list);
+    replayJournal(list);
+    EntityIndex::assignIds(list);
+    return list;
+}
+
+void FileDatabase::replayJournal(QVector<Company> &companies) const {
+    const auto entries = m_journal.read(ChangeJournal::stampOf(companiesFilePath()));
+    for (qsizetype i = 0; i < entries.size(); ++i) {
+        try {
+            ChangeJournal::apply(companies, entries[i]);
+        } catch (const std::exception& e) {
+            qWarning() << "Journal replay stopped at record" << i + 1 << ":" << e.what();
+            break;
+        }
+    }
+}
+
+QVector<Company> FileDatabase::loadBaseCompanies() const {
+    // Снимок новее текстового файла - читаем его и не разбираем текст
+    if (isSnapshotFresh()) {
+        try {
+            QVector<Company> list = BinarySnapshot::read(snapshotFilePath());
+            qDebug() << "Successfully loaded" << list.size() << "companies from snapshot";
+            return list;
+        } catch (const DatabaseException& e) {
+            qWarning() << "Binary snapshot is unusable, falling back to text file:" << e.what();
+        }
+    }
+
     QFile file(companiesFilePath());
 
     if (!file.exists()) {
         qWarning() << "Companies file does not exist, will be created on save";
-        return list;
+        return {};
+    }
+
+    QByteArray buffer;
+    const QByteArrayView data = readCompaniesFile(file, m_loadMode, buffer);
+
+    QVector<Company> list;
+    int lineNumber = 0;
+
+    try {
+        list = parseCompanies(data, lineNumber);
+    } catch (const std::exception& e) {
+        file.close();
+        // Перебрасываем исключение с дополнительной информацией
+        throw DatabaseException(QString("Error parsing companies file at line %1: %2").arg(lineNumber).arg(e.what()));
     }
 
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    file.close();
+    qDebug() << "Successfully loaded" << list.size() << "companies";
+    return list;
+}
+
+QByteArrayView FileDatabase::readCompaniesFile(QFile &file, LoadMode mode, QByteArray &buffer) const {
+    if (!file.open(QIODevice::ReadOnly)) {
         throw DatabaseException(QString("Could not open companies file for reading: %1. Error: %2")
                                     .arg(file.fileName()).arg(file.errorString()));
     }
 
-    QTextStream in(&file);
-    in.setEncoding(QStringConverter::Utf8);
+    // Отображаем файл в память и разбираем UTF-8 байты напрямую;
+    // если отображение недоступно, читаем файл целиком в буфер
+    if (const qint64 size = file.size(); mode == LoadMode::MemoryMapped && size > 0) {
+        if (const uchar *mapped = file.map(0, size)) {
+            return QByteArrayView(mapped, size);
+        }
+    }
+    buffer = file.readAll();
+    return buffer;
+}
+
+void FileDatabase::streamCompanies(ParseSink &sink) const {
+    QFile file(companiesFilePath());
 
-    Company currentCompany;
-    std::shared_ptr<Route> currentRoute;
-    int lineNumber = 0;
+    // Отображение не держит файл в куче, поэтому память не растет с размером файла
+    QByteArray buffer;
+    QByteArrayView data = readCompaniesFile(file, LoadMode::MemoryMapped, buffer);
+    if (data.startsWith(utf8Bom)) {
+        data = data.sliced(utf8Bom.size());
+    }
 
+    int lineNumber = 0;
     try {
-        while (!in.atEnd()) {
-            lineNumber++;
-            QString line = in.readLine().trimmed();
-            if (line.isEmpty()) continue;
-
-            if (line == "---") {
-                processCompanySeparator(currentCompany, currentRoute, list);
-                continue;
-            }
+        parseCompanyBlock(data, lineNumber, sink);
+    } catch (const ValidationException& e) {
+        throw DatabaseException(QString("Error parsing companies file at line %1: %2").arg(lineNumber).arg(e.what()));
+    }
+}
 
-            if (line.startsWith("Company: ")) {
-                processCompanyLine(line, lineNumber, currentCompany, currentRoute, list);
-                continue;
-            }
+bool FileDatabase::canStreamCompanies() const {
+    // Несохраненные правки и правки из журнала есть только в собранном списке. Файл без id
+    // ждет полной перезаписи (m_fullSaveRequired): до нее потоковый обход выдал бы нулевые id
+    if (hasUnsavedChanges()) {
+        return false;
+    }
+    const QString path = companiesFilePath();
+    return QFile::exists(path) && !m_journal.hasEntries(ChangeJournal::stampOf(path));
+}
 
-            if (line.startsWith("Route: ")) {
-                processRouteLine(line, lineNumber, currentCompany, currentRoute);
-                continue;
-            }
+bool FileDatabase::hasUnsavedChanges() const {
+    return !m_pendingEntries.isEmpty() || m_fullSaveRequired || m_autoSaveWatcher->isRunning();
+}
 
-            if (line.startsWith("Stop: ")) {
-                processStopLine(line, lineNumber, currentRoute);
-                continue;
-            }
+QVector<Company> FileDatabase::visitedCompanies() const {
+    // Принятые, но еще не записанные правки есть только в памяти
+    return hasUnsavedChanges() ? m_companies : loadCompanies();
+}
+
+void FileDatabase::forEachCompany(const std::function<void(const Company&)>& visit) const {
+    if (!canStreamCompanies()) {
+        for (const Company& company : visitedCompanies()) {
+            visit(company);
+        }
+        return;
+    }
 
-            if (line.startsWith("Trip: ")) {
-                processTripLine(line, lineNumber, currentRoute);
-                continue;
+    CompanyVisitor sink(visit);
+    streamCompanies(sink);
+}
+
+void FileDatabase::forEachRoute(const std::function<void(const QString&, const Route&)>& visit) const {
+    if (!canStreamCompanies()) {
+        for (const Company& company : visitedCompanies()) {
+            for (const auto& route : company.routes()) {
+                visit(company.name(), *route);
             }
+        }
+        return;
+    }
+
+    RouteVisitor sink(visit);
+    streamCompanies(sink);
+}
+
+void FileDatabase::forEachTrip(const QDateTime& start, const QDateTime& end,
+                               const std::function<void(const QString&, const Route&, const Trip&)>& visit) const {
+    const qint32 fromMinutes = Trip::toMinutes(start);
+    const qint32 toMinutes = Trip::toMinutes(end);
+    if (fromMinutes == Trip::INVALID_MINUTES || toMinutes == Trip::INVALID_MINUTES || fromMinutes >= toMinutes) {
+        return;
+    }
 
-            // Неизвестный формат строки
-            throw ValidationException(QString("Unknown line format at line %1: %2").arg(lineNumber).arg(line));
+    if (!canStreamCompanies()) {
+        for (const Company& company : visitedCompanies()) {
+            for (const auto& route : company.routes()) {
+                for (const Trip& trip : route->trips(fromMinutes, toMinutes)) {
+                    visit(company.name(), *route, trip);
+                }
+            }
         }
+        return;
+    }
 
-        if (currentRoute)
-            currentCompany.addRoute(currentRoute);
-        if (!currentCompany.name().isEmpty())
-            list.append(currentCompany);
+    TripVisitor sink(fromMinutes, toMinutes, visit);
+    streamCompanies(sink);
+}
 
-    } catch (const std::exception& e) {
-        file.close();
-        // Перебрасываем исключение с дополнительной информацией
-        throw DatabaseException(QString("Error parsing companies file at line %1: %2").arg(lineNumber).arg(e.what()));
+void FileDatabase::setLoadMode(LoadMode mode) {
+    m_loadMode = mode;
+}
+
+FileDatabase::LoadMode FileDatabase::loadMode() const {
+    return m_loadMode;
+}
+
+QVector<Company> FileDatabase::parseCompanies(QByteArrayView data, int& lineNumber) const {
+    if (data.startsWith(utf8Bom)) {
+        data = data.sliced(utf8Bom.size());
     }
 
-    file.close();
-    qDebug() << "Successfully loaded" << list.size() << "companies";
+    // Небольшой файл быстрее разобрать в текущем потоке
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    const QVector<CompanyChunk> chunks = data.size() < PARALLEL_PARSE_MIN_BYTES || threadCount < 2
+                                             ? QVector<CompanyChunk>()
+                                             : splitAtSeparators(data, threadCount * 4);
+    if (chunks.size() < 2) {
+        QVector<Company> list;
+        CompanyCollector sink(list);
+        parseCompanyBlock(data, lineNumber, sink);
+        return list;
+    }
+
+    struct ChunkResult {
+        QVector<Company> companies;
+        int lineNumber = 0;
+        std::exception_ptr error;
+    };
+
+    const QList<ChunkResult> results = QtConcurrent::blockingMapped(chunks, [this](const CompanyChunk& chunk) {
+        ChunkResult result;
+        result.lineNumber = chunk.firstLine - 1;
+        try {
+            CompanyCollector sink(result.companies);
+            parseCompanyBlock(chunk.data, result.lineNumber, sink);
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+        return result;
+    });
+
+    // Склеиваем в порядке файла; первая по порядку ошибка совпадает с ошибкой последовательного разбора
+    QVector<Company> list;
+    for (const ChunkResult& result : results) {
+        lineNumber = result.lineNumber;
+        if (result.error) {
+            std::rethrow_exception(result.error);
+        }
+        list.append(result.companies);
+    }
     return list;
 }
 
+void FileDatabase::parseCompanyBlock(QByteArrayView data, int& lineNumber, ParseSink& sink) const {
+    Company currentCompany;
+    std::shared_ptr<Route> currentRoute;
+
+    const char *cursor = data.data();
+    const char *const end = cursor + data.size();
+
+    while (cursor < end) {
+        const auto *newline = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+        const char *lineEnd = newline ? newline : end;
+        lineNumber++;
+
+        const QByteArrayView line = trimmedUtf8(QByteArrayView(cursor, lineEnd));
+        cursor = newline ? newline + 1 : end;
+        if (line.isEmpty()) continue;
+
+        if (line == "---") {
+            processCompanySeparator(currentCompany, currentRoute, sink);
+            continue;
+        }
+
+        // Строки сущностей: "Tag: ..." или "Tag#id: ..."
+        quint32 id = 0;
+        QByteArrayView body;
+
+        if (splitTaggedLine(line, "Company", id, body)) {
+            processCompanyLine(body, id, lineNumber, currentCompany, currentRoute, sink);
+            continue;
+        }
+
+        if (splitTaggedLine(line, "Route", id, body)) {
+            processRouteLine(body, id, lineNumber, currentCompany, currentRoute, sink);
+            continue;
+        }
+
+        if (splitTaggedLine(line, "Stop", id, body)) {
+            processStopLine(body, id, lineNumber, currentRoute);
+            continue;
+        }
+
+        if (splitTaggedLine(line, "Trip", id, body)) {
+            processTripLine(body, id, lineNumber, currentCompany, currentRoute, sink);
+            continue;
+        }
+
+        if (splitTaggedLine(line, "Rule", id, body)) {
+            processRuleLine(body, lineNumber, currentCompany, currentRoute, sink);
+            continue;
+        }
+
+        // Неизвестный формат строки
+        throw ValidationException(QString("Unknown line format at line %1: %2").arg(lineNumber).arg(QString::fromUtf8(line)));
+    }
+
+    if (currentRoute)
+        sink.routeParsed(currentCompany, currentRoute);
+    if (!currentCompany.name().isEmpty())
+        sink.companyParsed(currentCompany);
+}
+
 void FileDatabase::saveCompanies() {
-    QFile file(companiesFilePath());
+    // Не пишем файл одновременно с фоновым автосохранением
+    m_autoSaveWatcher->waitForFinished();
+
+    writeCompaniesFile(m_companies);
+    m_pendingEntries.clear();
+    m_fullSaveRequired = false;
+}
 
+void FileDatabase::writeCompaniesFile(const QVector<Company> &companies) const {
     // Создаем директорию если не существует
     if (QDir dir(m_folderPath); !dir.exists() && !dir.mkpath(".")) {
         throw DatabaseException(QString("Could not create data directory: %1").arg(m_folderPath));
     }
 
+    // QSaveFile пишет во временный файл, при commit() сбрасывает его на диск
+    // и атомарно подменяет companies.txt: при сбое остается прежняя версия файла
+    QSaveFile file(companiesFilePath());
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
         throw DatabaseException(QString("Could not open companies file for writing: %1. Error: %2")
                                     .arg(file.fileName()).arg(file.errorString()));
@@ -123,11 +642,11 @@ void FileDatabase::saveCompanies() {
 
     try {
         // Валидация данных перед сохранением
-        validateCompanies(m_companies);
+        validateCompanies(companies);
 
-        for (int i = 0; i < m_companies.size(); ++i) {
-            const bool isLast = (i == m_companies.size() - 1);
-            saveCompany(m_companies[i], out, isLast);
+        for (int i = 0; i < companies.size(); ++i) {
+            const bool isLast = (i == companies.size() - 1);
+            saveCompany(companies[i], out, isLast);
         }
 
         // Проверяем статус записи вместо flush()
@@ -136,15 +655,26 @@ void FileDatabase::saveCompanies() {
             throw DatabaseException("Failed to write data to file");
         }
 
+        if (!file.commit()) {
+            throw DatabaseException(file.errorString());
+        }
+
     } catch (const std::exception& e) {
-        file.close();
-        // Удаляем частично записанный файл
-        file.remove();
+        // Незавершенный временный файл удаляется QSaveFile, исходный файл не тронут
         throw DatabaseException(QString("Error writing companies file: %1").arg(e.what()));
     }
 
-    file.close();
-    qDebug() << "Data saved successfully to" << file.fileName();
+    qDebug() << "Data saved successfully to" << companiesFilePath();
+
+    writeSnapshot(companies);
+
+    // Все правки теперь в базовом файле - начинаем журнал заново
+    try {
+        m_journal.reset(ChangeJournal::stampOf(companiesFilePath()));
+    } catch (const DatabaseException& e) {
+        qWarning() << "Failed to reset journal:" << e.what();
+        QFile::remove(journalFilePath());
+    }
 }
 
 void FileDatabase::validateCompany(const Company& company, QSet<QString>& companyNames) const {
@@ -180,7 +710,7 @@ void FileDatabase::validateCompanies(const QVector<Company> &companies) const {
 }
 
 
-void FileDatabase::validateRoute(const std::shared_ptr<Route>& route, const QString& companyName, QList<QString>& routeNames) const {
+void FileDatabase::validateRoute(const std::shared_ptr<const Route>& route, const QString& companyName, QList<QString>& routeNames) const {
     if (route->name().isEmpty()) {
         throw ValidationException(QString("Empty route name in company: %1").arg(companyName));
     }
@@ -191,19 +721,47 @@ void FileDatabase::validateRoute(const std::shared_ptr<Route>& route, const QStr
         throw ValidationException(QString("Route '%1' has no stops").arg(route->name()));
     }
 
-    for (const auto &trip : route->trips()) {
-        validateTrip(trip, route->name());
+    for (qint32 departure : route->tripDepartures()) {
+        validateTrip(departure, route->name());
+    }
+
+    for (const TripRule& rule : route->tripRules()) {
+        if (!rule.isValid()) {
+            throw ValidationException(QString("Invalid trip rule in route: %1").arg(route->name()));
+        }
     }
 }
 
 void FileDatabase::setCompanies(const QVector<Company> &companies) {
     try {
         validateCompanies(companies);
-        m_companies = companies;
+
+        // Новые сущности получают идентификаторы до записи в журнал
+        QVector<Company> next = companies;
+        EntityIndex::assignIds(next);
+
+        m_pendingEntries += ChangeJournal::diff(m_companies, next);
+        m_companies = std::move(next);
+        m_index = EntityIndex(m_companies);
+        ++m_generation;
         scheduleAutoSave();
     } catch (const ValidationException& e) {
         throw ValidationException(QString("Invalid companies data: %1").arg(e.what()));
     }
+
+    emit companiesChanged();
+}
+
+QVector<Company> FileDatabase::companies() const {
+    return m_companies;
+}
+
+EntityIndex FileDatabase::index() const {
+    return m_index;
+}
+
+quint64 FileDatabase::generation() const {
+    return m_generation;
 }
 
 void FileDatabase::scheduleAutoSave() {
@@ -217,38 +775,92 @@ void FileDatabase::setAutoSaveEnabled(bool enabled) {
     }
 }
 
+void FileDatabase::setJournalCompactionThreshold(qint64 bytes) {
+    m_journalCompactionThreshold = bytes;
+}
+
 void FileDatabase::performAutoSave() {
+    // Запись уже идет - объединяем новые правки в следующую
+    if (m_autoSaveWatcher->isRunning()) {
+        m_autoSaveRequested = true;
+        return;
+    }
+
+    m_autoSaveRequested = false;
+    const AutoSaveJob job = takeAutoSaveJob();
+    m_autoSaveWatcher->setFuture(QtConcurrent::run([this, job]() { return writeAutoSave(job); }));
+}
+
+void FileDatabase::onAutoSaveFinished() {
+    const AutoSaveResult result = m_autoSaveWatcher->result();
+    if (!result.success) {
+        // Часть правок могла не попасть в журнал - следующая запись будет полной
+        m_fullSaveRequired = true;
+        qCritical() << "Auto-save failed:" << result.errorMessage;
+    }
+
+    emit autoSaveFinished(result.success, result.errorMessage);
+
+    if (m_autoSaveRequested) {
+        performAutoSave();
+    }
+}
+
+FileDatabase::AutoSaveJob FileDatabase::takeAutoSaveJob() {
+    AutoSaveJob job;
+    job.companies = m_companies;     // неявно разделяемая копия, маршруты на месте не меняются
+    job.entries = std::exchange(m_pendingEntries, {});
+    job.compactionThreshold = m_journalCompactionThreshold;
+    job.fullSave = std::exchange(m_fullSaveRequired, false);
+    return job;
+}
+
+// Выполняется в пуле потоков: обращается только к снимку job и неизменяемым путям
+FileDatabase::AutoSaveResult FileDatabase::writeAutoSave(const AutoSaveJob &job) const {
     try {
-        saveCompanies();
+        // Журнал дописывается только поверх базового файла, которому он принадлежит
+        bool rewrite = job.fullSave || !QFile::exists(companiesFilePath())
+                       || !m_journal.matches(ChangeJournal::stampOf(companiesFilePath()));
+
+        if (!rewrite) {
+            try {
+                m_journal.append(job.entries);
+            } catch (const DatabaseException& e) {
+                qWarning() << "Journal append failed, rewriting companies file:" << e.what();
+                rewrite = true;
+            }
+        }
+
+        // Сворачиваем разросшийся журнал в базовый файл
+        if (rewrite || m_journal.size() > job.compactionThreshold) {
+            writeCompaniesFile(job.companies);
+        }
+        return {true, QString()};
+
     } catch (const DatabaseException& e) {
-        qCritical() << "Auto-save failed:" << e.what();
+        return {false, QString::fromUtf8(e.what())};
 
     } catch (const ValidationException& e) {
-        qCritical() << "Auto-save validation failed:" << e.what();
+        return {false, QString("Validation failed: %1").arg(e.what())};
     }
 }
 
-void FileDatabase::validateStop(const std::shared_ptr<Stop>& stop) const {
-    if (!stop) {
-        throw ValidationException("Stop is null");
-    }
-    if (stop->city.isEmpty()) {
+void FileDatabase::validateStop(const Route& route, int position) const {
+    const QString city = route.stopCity(position);
+    if (city.isEmpty()) {
         throw ValidationException("Stop city cannot be empty");
     }
 
-    if (stop->durationMinutes < 0) {
-        throw ValidationException(QString("Invalid duration for stop '%1': %2").arg(stop->city).arg(stop->durationMinutes));
+    if (route.stopDuration(position) < 0) {
+        throw ValidationException(QString("Invalid duration for stop '%1': %2").arg(city).arg(route.stopDuration(position)));
     }
-    if (stop->price < 0) {
-        throw ValidationException(QString("Invalid price for stop '%1': %2").arg(stop->city).arg(stop->price));
+    if (route.stopPrice(position) < 0) {
+        throw ValidationException(QString("Invalid price for stop '%1': %2").arg(city).arg(route.stopPrice(position)));
     }
 }
 
-void FileDatabase::validateTrip(const std::shared_ptr<Trip>& trip, const QString& routeName) const {
-    if (!trip) {
-        throw ValidationException("Trip is null");
-    }
-    if (!trip->departure().isValid()) {
+void FileDatabase::validateTrip(qint32 departureMinutes, const QString& routeName) const {
+    if (departureMinutes == Trip::INVALID_MINUTES) {
         if (routeName.isEmpty()) {
             throw ValidationException("Trip has invalid departure datetime");
         } else {
@@ -257,59 +869,68 @@ void FileDatabase::validateTrip(const std::shared_ptr<Trip>& trip, const QString
     }
 }
 
-void FileDatabase::processCompanySeparator(Company& currentCompany, std::shared_ptr<Route>& currentRoute, QVector<Company>& list) const {
+void FileDatabase::processCompanySeparator(Company& currentCompany, std::shared_ptr<Route>& currentRoute, ParseSink& sink) const {
     if (currentRoute) {
-        currentCompany.addRoute(currentRoute);
+        sink.routeParsed(currentCompany, currentRoute);
     }
     if (!currentCompany.name().isEmpty()) {
-        list.append(currentCompany);
+        sink.companyParsed(currentCompany);
     }
     currentCompany = Company();
     currentRoute = nullptr;
 }
 
-void FileDatabase::processCompanyLine(const QString& line, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute, QVector<Company>& list) const {
+void FileDatabase::processCompanyLine(QByteArrayView line, quint32 id, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute, ParseSink& sink) const {
     if (currentRoute) {
-        currentCompany.addRoute(currentRoute);
+        sink.routeParsed(currentCompany, currentRoute);
     }
     if (!currentCompany.name().isEmpty()) {
-        list.append(currentCompany);
+        sink.companyParsed(currentCompany);
     }
 
-    QString companyName = line.mid(QString("Company: ").length());
+    QString companyName = QString::fromUtf8(line);
     if (companyName.isEmpty()) {
         throw ValidationException(QString("Empty company name at line %1").arg(lineNumber));
     }
 
     currentCompany = Company(companyName);
+    currentCompany.setId(id);
     currentRoute = nullptr;
 }
 
-void FileDatabase::processRouteLine(const QString& line, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute) const {
+void FileDatabase::processRouteLine(QByteArrayView line, quint32 id, int lineNumber, Company& currentCompany, std::shared_ptr<Route>& currentRoute, ParseSink& sink) const {
     if (currentRoute) {
-        currentCompany.addRoute(currentRoute);
+        sink.routeParsed(currentCompany, currentRoute);
     }
 
-    QString routeName = line.mid(QString("Route: ").length());
+    QString routeName = QString::fromUtf8(line);
     if (routeName.isEmpty()) {
         throw ValidationException(QString("Empty route name at line %1").arg(lineNumber));
     }
 
     currentRoute = std::make_shared<Route>(routeName);
+    currentRoute->setId(id);
 }
 
-void FileDatabase::processStopLine(const QString& line, int lineNumber, const std::shared_ptr<Route>& currentRoute) const {
+void FileDatabase::processStopLine(QByteArrayView line, quint32 id, int lineNumber, const std::shared_ptr<Route>& currentRoute) const {
     if (!currentRoute) {
         throw ValidationException(QString("Stop without route at line %1").arg(lineNumber));
     }
 
-    QStringList parts = line.mid(6).split(';');
-    if (parts.size() < 3) {
-        throw ValidationException(QString("Invalid stop format at line %1. Expected: Stop:city;duration;price").arg(lineNumber));
+    // Поля "город;длительность;цена" режутся прямо по байтам строки
+    std::array<QByteArrayView, 3> parts;
+    QByteArrayView rest = line;
+    for (qsizetype i = 0; i < qsizetype(parts.size()); ++i) {
+        const qsizetype separator = rest.indexOf(';');
+        if (separator < 0 && i < qsizetype(parts.size()) - 1) {
+            throw ValidationException(QString("Invalid stop format at line %1. Expected: Stop:city;duration;price").arg(lineNumber));
+        }
+        parts[i] = separator < 0 ? rest : rest.first(separator);
+        rest = separator < 0 ? QByteArrayView() : rest.sliced(separator + 1);
     }
 
-    QString city = parts[0].trimmed();
-    if (city.isEmpty()) {
+    QByteArrayView cityBytes = trimmedUtf8(parts[0]);
+    if (cityBytes.isEmpty()) {
         throw ValidationException(QString("Empty city name at line %1").arg(lineNumber));
     }
 
@@ -320,27 +941,46 @@ void FileDatabase::processStopLine(const QString& line, int lineNumber, const st
 
 
     if (!durationOk || duration < 0) {
-        throw ValidationException(QString("Invalid duration at line %1: %2").arg(lineNumber).arg(parts[1]));
+        throw ValidationException(QString("Invalid duration at line %1: %2").arg(lineNumber).arg(QString::fromUtf8(parts[1])));
     }
 
     if (!priceOk || price < 0) {
-        throw ValidationException(QString("Invalid price at line %1: %2").arg(lineNumber).arg(parts[2]));
+        throw ValidationException(QString("Invalid price at line %1: %2").arg(lineNumber).arg(QString::fromUtf8(parts[2])));
     }
 
-    currentRoute->addStop(city, duration, price);
+    currentRoute->addStop(QString::fromUtf8(cityBytes), duration, price, id);
 }
 
-void FileDatabase::processTripLine(const QString& line, int lineNumber, const std::shared_ptr<Route>& currentRoute) const {
+void FileDatabase::processTripLine(QByteArrayView line, quint32 id, int lineNumber, const Company& currentCompany, const std::shared_ptr<Route>& currentRoute, ParseSink& sink) const {
     if (!currentRoute) {
         throw ValidationException(QString("Trip without route at line %1").arg(lineNumber));
     }
 
-    QDateTime dep = QDateTime::fromString(line.mid(6), Qt::ISODate);
-    if (!dep.isValid()) {
-        throw ValidationException(QString("Invalid trip datetime at line %1: %2").arg(lineNumber).arg(line.mid(6)));
+    // Обычный вид "yyyy-MM-ddTHH:mm[:ss]" разбирается без QDateTime; прочие варианты ISO 8601 - через него
+    qint32 departure = Trip::INVALID_MINUTES;
+    if (!Trip::parseIsoMinutes(line, departure)) {
+        const QString text = QString::fromUtf8(line);
+        departure = Trip::toMinutes(QDateTime::fromString(text, Qt::ISODate));
+        if (departure == Trip::INVALID_MINUTES) {
+            throw ValidationException(QString("Invalid trip datetime at line %1: %2").arg(lineNumber).arg(text));
+        }
+    }
+
+    sink.tripParsed(currentCompany, *currentRoute, departure, id);
+}
+
+void FileDatabase::processRuleLine(QByteArrayView line, int lineNumber, const Company& currentCompany, const std::shared_ptr<Route>& currentRoute, ParseSink& sink) const {
+    if (!currentRoute) {
+        throw ValidationException(QString("Rule without route at line %1").arg(lineNumber));
+    }
+
+    // "yyyy-MM-dd;yyyy-MM-dd;HH:mm,HH:mm[;yyyy-MM-dd,...]"
+    TripRule rule;
+    if (!TripRule::parse(line, rule)) {
+        throw ValidationException(QString("Invalid trip rule at line %1: %2").arg(lineNumber).arg(QString::fromUtf8(line)));
     }
 
-    currentRoute->addTrip(dep);
+    sink.tripRuleParsed(currentCompany, *currentRoute, rule);
 }
 
 void FileDatabase::saveCompany(const Company& company, QTextStream& out, bool isLast) const {
@@ -348,7 +988,8 @@ void FileDatabase::saveCompany(const Company& company, QTextStream& out, bool is
         throw ValidationException("Company name cannot be empty");
     }
 
-    out << "Company: " << company.name() << "\r\n";
+    writeTag(out, "Company", company.id());
+    out << company.name() << "\r\n";
 
     for (const auto &route : company.routes()) {
         saveRoute(route, out);
@@ -359,7 +1000,7 @@ void FileDatabase::saveCompany(const Company& company, QTextStream& out, bool is
     }
 }
 
-void FileDatabase::saveRoute(const std::shared_ptr<Route>& route, QTextStream& out) const {
+void FileDatabase::saveRoute(const std::shared_ptr<const Route>& route, QTextStream& out) const {
     if (route->name().isEmpty()) {
         throw ValidationException("Route name cannot be empty");
     }
@@ -368,17 +1009,28 @@ void FileDatabase::saveRoute(const std::shared_ptr<Route>& route, QTextStream& o
         throw ValidationException(QString("Route '%1' has no stops").arg(route->name()));
     }
 
-    out << "Route: " << route->name() << "\r\n";
+    writeTag(out, "Route", route->id());
+    out << route->name() << "\r\n";
 
 
-    for (auto stop = route->firstStop(); stop; stop = stop->next) {
-        validateStop(stop);
-        out << "Stop: " << stop->city << ";" << stop->durationMinutes << ";" << stop->price << "\r\n";
+    for (int s = 0; s < route->totalStops(); ++s) {
+        validateStop(*route, s);
+        writeTag(out, "Stop", route->stopId(s));
+        out << route->stopCity(s) << ";" << route->stopDuration(s) << ";" << route->stopPrice(s) << "\r\n";
     }
 
     // Сохраняем рейсы
-    for (const auto &trip : route->trips()) {
-        validateTrip(trip, route->name());
-        out << "Trip: " << trip->departure().toString(Qt::ISODate) << "\r\n";
+    for (int t = 0; t < route->tripCount(); ++t) {
+        validateTrip(route->tripDeparture(t), route->name());
+        writeTag(out, "Trip", route->tripId(t));
+        out << Trip::formatIsoMinutes(route->tripDeparture(t)) << "\r\n";
+    }
+
+    // Правила расписания не имеют идентификаторов и сохраняются по порядку
+    for (const TripRule& rule : route->tripRules()) {
+        if (!rule.isValid()) {
+            throw ValidationException(QString("Invalid trip rule in route: %1").arg(route->name()));
+        }
+        out << "Rule: " << rule.format() << "\r\n";
     }
 }
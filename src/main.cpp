@@ -1,6 +1,7 @@
 #include <QApplication>
 #include "mainwindow.h"
 #include "mainmenu.h"  // Добавляем заголовок главного меню
+#include "filedatabase.h"
 #include <QPalette>
 #include <QStyleFactory>
 
@@ -28,8 +29,11 @@ int main(int argc, char *argv[]) {
 
     app.setStyleSheet("QToolTip { color: #ffffff; background-color: #2a82da; border: 1px solid white; }");
 
+    // Одна база на весь процесс: окна работают с общими снимками данных
+    FileDatabase database("data");
+
     // Запускаем главное меню вместо основного окна управления
-    MainMenu mainMenu;
+    MainMenu mainMenu(&database);
     mainMenu.show();
 
     return QApplication::exec();
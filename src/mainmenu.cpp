@@ -9,15 +9,25 @@
 #include <QLabel>
 #include <QGroupBox>
 
-MainMenu::MainMenu(QWidget *parent)
-    : QMainWindow(parent)
+namespace {
+// Сколько дней вперед показываются рейсы по правилам расписания
+constexpr qint32 RULE_TRIPS_WINDOW_DAYS = 30;
+}
+
+MainMenu::MainMenu(FileDatabase *database, QWidget *parent)
+    : QMainWindow(parent), db(database)
 {
-    db = new FileDatabase("data", this);
     setupUI();
     loadData();
     updateFilters();
     refreshTrips();
 
+    // Правки из окна управления приходят новой версией данных, без перечитывания файла
+    connect(db, &FileDatabase::companiesChanged, this, [this]() {
+        loadData();
+        refreshTrips();
+    });
+
     // Автообновление всегда включено
     autoRefreshTimer = new QTimer(this);
     connect(autoRefreshTimer, &QTimer::timeout, this, &MainMenu::refreshTrips);
@@ -85,7 +95,8 @@ void MainMenu::setupUI()
 
 void MainMenu::loadData()
 {
-    companies = db->loadCompanies();
+    companies = db->companies();
+    index = db->index();
     if (companies.isEmpty()) {
         companies.append(Company("Default Bus Co."));
     }
@@ -113,46 +124,53 @@ void MainMenu::updateFilters()
 
 void MainMenu::refreshTrips()
 {
-    // Собираем все рейсы из всех компаний
-    QVector<QPair<std::shared_ptr<Trip>, std::shared_ptr<Route>>> allTrips;
-
-    for (const auto &company : companies) {
-        for (const auto &route : company.routes()) {
-            for (const auto &trip : route->trips()) {
-                allTrips.append(qMakePair(trip, route));
-            }
-        }
-    }
+    const auto companyNameOf = [this](const Route *route) {
+        const EntityLocation location = index.route(route->id());
+        return location.isValid() ? companies[location.company].name() : QString();
+    };
 
     // Применяем фильтры
     QString searchText = searchEdit->text().toLower();
-    QString selectedCompany = companyFilter->currentData().toString();
 
-    QVector<QPair<std::shared_ptr<Trip>, std::shared_ptr<Route>>> filteredTrips;
+    // Города, подходящие под строку поиска, ищутся в словаре один раз, а не в каждой остановке
+    matchingCities.clear();
+    if (!searchText.isEmpty()) {
+        for (CityId city : CityDictionary::instance().findContaining(searchText)) {
+            matchingCities.insert(city);
+        }
+    }
+
+    // Рейсы по правилам расписания показываются только в ближайшем окне, а не за весь период правила
+    const qint32 windowStart = Trip::toMinutes(QDateTime(QDate::currentDate(), QTime(0, 0)));
+    const qint32 windowEnd = windowStart + RULE_TRIPS_WINDOW_DAYS * 24 * 60;
 
-    for (const auto &tripPair : allTrips) {
-        const auto &trip = tripPair.first;
-        const auto &route = tripPair.second;
+    // Фильтры зависят только от маршрута, поэтому проверяются один раз на маршрут;
+    // рейс задается маршрутом и временем отправления в минутах
+    QVector<QPair<const Route *, qint32>> filteredTrips;
 
-        // Находим компанию для этого маршрута
-        QString companyName;
-        for (const auto &company : companies) {
-            if (company.routes().contains(route)) {
-                companyName = company.name();
-                break;
+    for (const auto &company : companies) {
+        for (const auto &route : company.routes()) {
+            if (!routeMatchesFilter(route, company.name())) {
+                continue;
+            }
+            for (qint32 departure : route->tripDepartures()) {
+                filteredTrips.append(qMakePair(route.get(), departure));
             }
-        }
 
-        if (tripMatchesFilter(trip, route, companyName)) {
-            filteredTrips.append(tripPair);
+            QVector<qint32> ruleDepartures;
+            for (const TripRule &rule : route->tripRules()) {
+                rule.expand(windowStart, windowEnd, ruleDepartures);
+            }
+            for (qint32 departure : ruleDepartures) {
+                filteredTrips.append(qMakePair(route.get(), departure));
+            }
         }
     }
 
-    // Сортируем по времени отправления (ближайшие сначала)
+    // Сортируем по времени отправления (ближайшие сначала) - сравниваются целые минуты
     std::ranges::sort(filteredTrips,
-              [this](const auto &a, const auto &b) {
-                  return getTripDeparture(a.first, a.second) <
-                         getTripDeparture(b.first, b.second);
+              [](const auto &a, const auto &b) {
+                  return a.second < b.second;
               });
 
     // Обновляем таблицу
@@ -160,24 +178,18 @@ void MainMenu::refreshTrips()
     tableTrips->setRowCount(filteredTrips.size());
 
     qsizetype i = 0;
-    for (const auto &[trip, route] : filteredTrips) {
-
-        // Находим компанию для этого маршрута
-        QString companyName;
-        for (const auto &company : companies) {
-            if (company.routes().contains(route)) {
-                companyName = company.name();
-                break;
-            }
-        }
-
-        QDateTime departure = getTripDeparture(trip, route);
-        QDateTime arrival = trip->arrival(*route);
+    for (const auto &[route, departureMinutes] : filteredTrips) {
+        const Trip trip = Trip::fromMinutes(departureMinutes);
+        QDateTime departure = trip.departure();
+        QDateTime arrival = trip.arrival(*route);
 
         tableTrips->setItem(i, 0, new QTableWidgetItem(departure.toString("dd.MM.yyyy HH:mm")));
         tableTrips->setItem(i, 1, new QTableWidgetItem(arrival.toString("dd.MM.yyyy HH:mm")));
-        tableTrips->setItem(i, 2, new QTableWidgetItem(route->name()));
-        tableTrips->setItem(i, 3, new QTableWidgetItem(companyName));
+        // id маршрута хранится в ячейке и переживает сортировку таблицы
+        auto *routeItem = new QTableWidgetItem(route->name());
+        routeItem->setData(Qt::UserRole, route->id());
+        tableTrips->setItem(i, 2, routeItem);
+        tableTrips->setItem(i, 3, new QTableWidgetItem(companyNameOf(route)));
         tableTrips->setItem(i, 4, new QTableWidgetItem(QString::number(route->totalDuration()) + " мин"));
         tableTrips->setItem(i, 5, new QTableWidgetItem(QString::number(route->totalPrice(), 'f', 2) + " руб"));
         ++i;
@@ -187,7 +199,7 @@ void MainMenu::refreshTrips()
     tableTrips->resizeColumnsToContents();
 }
 
-bool MainMenu::tripMatchesFilter(const std::shared_ptr<Trip>&, const std::shared_ptr<Route>& route, const QString& companyName) const
+bool MainMenu::routeMatchesFilter(const std::shared_ptr<const Route>& route, const QString& companyName) const
 {
     QString searchText = searchEdit->text().toLower();
 
@@ -211,12 +223,11 @@ bool MainMenu::tripMatchesFilter(const std::shared_ptr<Trip>&, const std::shared
             textFound = true;
         }
 
-        // Поиск в городах остановок
-        for (auto stop = route->firstStop(); stop; stop = stop->next) {
-            if (stop->city.toLower().contains(searchText)) {
-                textFound = true;
-                break;
-            }
+        // Поиск в городах остановок по заранее отобранным номерам городов
+        if (!textFound) {
+            textFound = std::ranges::any_of(route->stopCityIds(), [this](CityId city) {
+                return matchingCities.contains(city);
+            });
         }
 
         if (!textFound) {
@@ -227,45 +238,24 @@ bool MainMenu::tripMatchesFilter(const std::shared_ptr<Trip>&, const std::shared
     return true;
 }
 
-QDateTime MainMenu::getTripDeparture(const std::shared_ptr<Trip>& trip, const std::shared_ptr<Route>&) const
-{
-    return trip->departure();
-}
-
 void MainMenu::onTripDoubleClicked(int row, int /*column*/)
 {
 
-    // Находим маршрут для выбранного рейса
-    QString routeName = tableTrips->item(row, 2)->text();
-    QString companyName = tableTrips->item(row, 3)->text();
-
-    for (const auto &company : companies) {
-        if (company.name() != companyName) {
-            continue;
-        }
-        for (const auto &route : company.routes()) {
-            if (route->name() == routeName) {
-                RouteDetailsDialog dlg(*route, this);
-                dlg.exec();
-                return;
-            }
-        }
-        break;
+    // Находим маршрут выбранного рейса по сохраненному идентификатору
+    const quint32 routeId = tableTrips->item(row, 2)->data(Qt::UserRole).toUInt();
+    const EntityLocation location = index.route(routeId);
+    if (!location.isValid()) {
+        return;
     }
+
+    RouteDetailsDialog dlg(*companies.at(location.company).routes().at(location.route), this);
+    dlg.exec();
 }
 
 void MainMenu::onManageRoutes()
 {
-    auto *manageWindow = new MainWindow();
+    auto *manageWindow = new MainWindow(db);
     manageWindow->setAttribute(Qt::WA_DeleteOnClose);
-
-
-    connect(manageWindow, &MainWindow::destroyed, this, [this]() {
-
-        loadData();
-        refreshTrips();
-    });
-
     manageWindow->show();
 }
 
@@ -19,10 +19,9 @@
 #include <QLabel>
 #include <QGroupBox>
 
-MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent)
+MainWindow::MainWindow(FileDatabase *database, QWidget *parent)
+    : QMainWindow(parent), db(database)
 {
-    db = new FileDatabase("data", this);
 
     auto *central = new QWidget(this);
     setCentralWidget(central);
@@ -82,13 +81,23 @@ MainWindow::MainWindow(QWidget *parent)
     resize(1000, 700);
 }
 
-void MainWindow::onEditRoute(int row) {
+EntityLocation MainWindow::locateRoute(quint32 routeId) const {
+    // После каждой публикации рабочая копия совпадает с версией базы, поэтому подходит ее индекс
+    const EntityLocation location = db->index().route(routeId);
+    if (!location.isValid() || location.company >= companies.size()
+        || location.route >= companies.at(location.company).routes().size()
+        || companies.at(location.company).routes().at(location.route)->id() != routeId) {
+        return {};
+    }
+    return location;
+}
+
+void MainWindow::onEditRoute(quint32 routeId) {
     try {
-        int idxC = cbCompany->currentIndex();
-        if (idxC < 0 || idxC >= companies.size()) return;
-        if (row < 0 || row >= companies[idxC].routes().size()) return;
+        const EntityLocation location = locateRoute(routeId);
+        if (!location.isValid()) return;
 
-        auto route = companies[idxC].routes()[row];
+        auto route = companies[location.company].mutableRoutes()[location.route];
         EditRouteDialog dlg(*route, this);
 
         if (dlg.exec() == QDialog::Accepted) {
@@ -103,50 +112,43 @@ void MainWindow::onEditRoute(int row) {
     }
 }
 
-void MainWindow::onCopyRoute(int row) {
-    int idxC = cbCompany->currentIndex();
-    if (idxC < 0 || idxC >= companies.size()) return;
-    if (row < 0 || row >= companies[idxC].routes().size()) return;
+void MainWindow::onCopyRoute(quint32 routeId) {
+    const EntityLocation location = locateRoute(routeId);
+    if (!location.isValid()) return;
 
-    auto originalRoute = companies[idxC].routes()[row];
+    // Копия получит новые идентификаторы при публикации
+    auto originalRoute = companies.at(location.company).routes().at(location.route);
     auto copiedRoute = std::make_shared<Route>(*originalRoute);
 
-    companies[idxC].addRoute(copiedRoute);
+    companies[location.company].addRoute(copiedRoute);
     onDataChanged();
 }
 
-void MainWindow::onRemoveRoute(int row) {
-    int idxC = cbCompany->currentIndex();
-    if (idxC < 0 || idxC >= companies.size()) return;
-    if (row < 0 || row >= companies[idxC].routes().size()) return;
+void MainWindow::onRemoveRoute(quint32 routeId) {
+    const EntityLocation location = locateRoute(routeId);
+    if (!location.isValid()) return;
 
     if (QMessageBox::question(this, "Подтверждение",
                               "Удалить выбранный маршрут?",
                               QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes) {
-        companies[idxC].routes().remove(row);
+        companies[location.company].mutableRoutes().remove(location.route);
         onDataChanged();
     }
 }
 
-void MainWindow::onShowRouteDetails(int row) {
-    int idxC = cbCompany->currentIndex();
-    if (idxC < 0 || idxC >= companies.size()) return;
-    if (row < 0 || row >= companies[idxC].routes().size()) return;
+void MainWindow::onShowRouteDetails(quint32 routeId) {
+    const EntityLocation location = locateRoute(routeId);
+    if (!location.isValid()) return;
 
-    const auto &route = companies[idxC].routes()[row];
+    const auto &route = companies.at(location.company).routes().at(location.route);
     RouteDetailsDialog dlg(*route, this);
     dlg.exec();
 }
 
 void MainWindow::loadCompanies() {
-    try {
-        companies = db->loadCompanies();
-        if (companies.isEmpty()) {
-            companies.append(Company("Default Bus Co."));
-        }
-    } catch (const DatabaseException& e) {
-        QMessageBox::warning(this, "Ошибка загрузки",
-                             QString("Не удалось загрузить данные: %1\nСоздана пустая компания.").arg(e.what()));
+    // Рабочая копия разделяет данные с базой до первой правки
+    companies = db->companies();
+    if (companies.isEmpty()) {
         companies.append(Company("Default Bus Co."));
     }
 }
@@ -154,12 +156,16 @@ void MainWindow::loadCompanies() {
 void MainWindow::onDataChanged() {
     try {
         db->setCompanies(companies);
-        refreshRoutesTable();
     } catch (const DatabaseException& e) {
         QMessageBox::critical(this, "Ошибка сохранения", e.what());
     } catch (const ValidationException& e) {
         QMessageBox::warning(this, "Ошибка валидации", e.what());
     }
+
+    // Берем опубликованную версию: в ней новым сущностям выданы идентификаторы,
+    // а отклоненная правка откатывается
+    companies = db->companies();
+    refreshRoutesTable();
 }
 
 void MainWindow::refreshCompanySelector() {
@@ -172,7 +178,7 @@ void MainWindow::refreshRoutesTable() {
     int idx = cbCompany->currentIndex();
     if (idx < 0 || idx >= companies.size()) return;
 
-    const auto &routes = companies[idx].routes();
+    const auto &routes = companies.at(idx).routes();
     tableRoutes->setRowCount(routes.size());
 
     for (int i = 0; i < routes.size(); ++i) {
@@ -180,7 +186,12 @@ void MainWindow::refreshRoutesTable() {
 
         tableRoutes->setItem(i, 0, new QTableWidgetItem(r->name()));
         tableRoutes->setItem(i, 1, new QTableWidgetItem(QString::number(r->totalStops())));
-        tableRoutes->setItem(i, 2, new QTableWidgetItem(QString::number(r->trips().size())));
+        // Правила расписания показываются рядом с числом отдельных рейсов
+        QString trips = QString::number(r->tripCount());
+        if (!r->tripRules().isEmpty()) {
+            trips += QString(" (правил: %1)").arg(r->tripRules().size());
+        }
+        tableRoutes->setItem(i, 2, new QTableWidgetItem(trips));
         tableRoutes->setItem(i, 3, new QTableWidgetItem(QString::number(r->totalDuration())));
 
         // Создаем контейнер для кнопок
@@ -193,32 +204,32 @@ void MainWindow::refreshRoutesTable() {
         auto *btnEdit = new QPushButton("✏️", this);
         btnEdit->setFixedSize(25, 25);
         btnEdit->setToolTip("Редактировать маршрут");
-        connect(btnEdit, &QPushButton::clicked, this, [this, i]() {
-            onEditRoute(i);
+        connect(btnEdit, &QPushButton::clicked, this, [this, routeId = r->id()]() {
+            onEditRoute(routeId);
         });
 
         // Кнопка копировать
         auto *btnCopy = new QPushButton("📋", this);
         btnCopy->setFixedSize(25, 25);
         btnCopy->setToolTip("Копировать маршрут");
-        connect(btnCopy, &QPushButton::clicked, this, [this, i]() {
-            onCopyRoute(i);
+        connect(btnCopy, &QPushButton::clicked, this, [this, routeId = r->id()]() {
+            onCopyRoute(routeId);
         });
 
         // Кнопка удалить
         auto *btnRemove = new QPushButton("❌", this);
         btnRemove->setFixedSize(25, 25);
         btnRemove->setToolTip("Удалить маршрут");
-        connect(btnRemove, &QPushButton::clicked, this, [this, i]() {
-            onRemoveRoute(i);
+        connect(btnRemove, &QPushButton::clicked, this, [this, routeId = r->id()]() {
+            onRemoveRoute(routeId);
         });
 
         // Кнопка детали
         auto *btnDetails = new QPushButton("👁️", this);
         btnDetails->setFixedSize(25, 25);
         btnDetails->setToolTip("Показать детали маршрута");
-        connect(btnDetails, &QPushButton::clicked, this, [this, i]() {
-            onShowRouteDetails(i);
+        connect(btnDetails, &QPushButton::clicked, this, [this, routeId = r->id()]() {
+            onShowRouteDetails(routeId);
         });
 
         buttonsLayout->addWidget(btnEdit);
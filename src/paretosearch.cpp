@@ -0,0 +1,194 @@
+#include "paretosearch.h"
+#include <algorithm>
+
+QVector<Journey> ParetoSearch::search(const CityRouteIndex &index, const Query &query) {
+    QVector<Journey> result;
+    if (query.to == query.from || query.to >= CityDictionary::instance().size() || !run(index, query)) {
+        return result;
+    }
+
+    for (int round = 1; round <= query.maxTransfers + 1; ++round) {
+        for (qint32 label : std::as_const(bag(round, m_target))) {
+            result.append(journeyFrom(label));
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const Journey &a, const Journey &b) {
+        return a.arrival() != b.arrival() ? a.arrival() < b.arrival() : a.price() < b.price();
+    });
+    return result;
+}
+
+QVector<ReachableCity> ParetoSearch::reachable(const CityRouteIndex &index, const Query &query) {
+    QVector<ReachableCity> result;
+    Query oneToAll = query;
+    oneToAll.to = CityDictionary::InvalidCityId;
+    if (!run(index, oneToAll)) {
+        return result;
+    }
+
+    for (CityId city = 0; city < m_cityCount; ++city) {
+        if (city == query.from) {
+            continue;
+        }
+        ReachableCity reach;
+        reach.city = city;
+        for (int round = 1; round <= query.maxTransfers + 1; ++round) {
+            for (qint32 labelIndex : std::as_const(bag(round, city))) {
+                const Label &label = m_labels[labelIndex];
+                reach.earliestArrival = std::min(reach.earliestArrival, label.arrival);
+                reach.lowestPrice = std::min(reach.lowestPrice, label.price);
+                reach.fewestTransfers = std::min(reach.fewestTransfers, round - 1);
+            }
+        }
+        if (reach.fewestTransfers <= query.maxTransfers) {
+            result.append(reach);
+        }
+    }
+    return result;
+}
+
+bool ParetoSearch::run(const CityRouteIndex &index, const Query &query) {
+    m_index = &index;
+    const qsizetype cityCount = CityDictionary::instance().size();
+    if (query.from >= cityCount || query.departAfter == Trip::INVALID_MINUTES || query.maxTransfers < 0) {
+        return false;
+    }
+
+    const int rounds = query.maxTransfers + 1;
+    m_cityCount = cityCount;
+    m_target = query.to;
+    m_labels.clear();
+    // Наборы очищаются, а не пересоздаются: их память переиспользуется между запросами
+    m_bags.resize(cityCount * (rounds + 1));
+    for (auto &labels : m_bags) {
+        labels.clear();
+    }
+    m_queue.reset(cityCount, index.slotCount());
+
+    // Все сравнения с limit нестрогие, а граница arriveBefore - строгая
+    const qint32 limit = static_cast<qint32>(std::min<qint64>(
+        std::min<qint64>(qint64(query.departAfter) + query.horizonMinutes, qint64(query.arriveBefore) - 1),
+        std::numeric_limits<qint32>::max()));
+
+    Label origin;
+    origin.arrival = query.departAfter;
+    m_labels.append(origin);
+    bag(0, query.from).append(0);
+    m_queue.mark(query.from);
+
+    for (int round = 1; round <= rounds && !m_queue.isEmpty(); ++round) {
+        m_queue.collectRoutes(index);
+        m_queue.forEachRoute([&](qint32 slot, qint32 fromPosition) {
+            scanRoute(slot, fromPosition, round, query, limit);
+        });
+    }
+    return true;
+}
+
+bool ParetoSearch::dominated(CityId city, int round, qint32 arrival, double price) const {
+    for (int r = 0; r <= round; ++r) {
+        for (qint32 index : m_bags[r * m_cityCount + city]) {
+            const Label &other = m_labels[index];
+            if (other.arrival <= arrival && other.price <= price) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool ParetoSearch::addLabel(CityId city, int round, const Label &label) {
+    // Поездки в город назначения отсекают все метки, которые их не превосходят
+    if (dominated(city, round, label.arrival, label.price)
+        || (m_target < m_cityCount && city != m_target && dominated(m_target, round, label.arrival, label.price))) {
+        return false;
+    }
+
+    auto &labels = bag(round, city);
+    labels.removeIf([&](qint32 index) {
+        return label.arrival <= m_labels[index].arrival && label.price <= m_labels[index].price;
+    });
+    labels.append(static_cast<qint32>(m_labels.size()));
+    m_labels.append(label);
+    m_queue.mark(city);
+    return true;
+}
+
+void ParetoSearch::scanRoute(qint32 slot, qint32 fromPosition, int round, const Query &query, qint32 limit) {
+    const Route &route = *m_index->route(slot);
+    const auto &cities = route.stopCityIds();
+    const auto &offsets = route.arrivalOffsets();
+    m_routeBag.clear();
+
+    for (qint32 position = fromPosition; position < cities.size(); ++position) {
+        const CityId city = cities[position];
+        if (city >= m_cityCount) {
+            continue;
+        }
+        const double priceHere = route.segmentPrice(0, position + 1);
+
+        // Высадка: каждая метка рейса дает кандидата в этом городе
+        for (const RouteLabel &onboard : std::as_const(m_routeBag)) {
+            const qint64 arrival = qint64(onboard.tripDeparture) + offsets[position];
+            const double price = onboard.basePrice + priceHere;
+            if (arrival > limit || price > query.maxPrice) {
+                continue;
+            }
+            Label label;
+            label.arrival = static_cast<qint32>(arrival);
+            label.price = price;
+            label.parent = onboard.parent;
+            label.slot = slot;
+            label.boardStop = onboard.boardStop;
+            label.alightStop = position;
+            label.tripDeparture = onboard.tripDeparture;
+            label.tripId = onboard.tripId;
+            addLabel(city, round, label);
+        }
+
+        // Посадка: метки предыдущего раунда в этом городе садятся на ближайший доступный рейс
+        for (qint32 index : std::as_const(bag(round - 1, city))) {
+            const Label &waiting = m_labels[index];
+            const qint64 ready = qint64(waiting.arrival) + (waiting.slot < 0 ? 0 : query.minTransferMinutes);
+            const qint64 wanted = ready - offsets[position];
+            if (wanted > limit) {
+                continue;
+            }
+            quint32 tripId = 0;
+            const qint32 departure = route.nextDeparture(static_cast<qint32>(std::max<qint64>(wanted, Trip::INVALID_MINUTES + 1)), &tripId);
+            if (departure == Trip::INVALID_MINUTES || qint64(departure) + offsets[position] > limit) {
+                continue;
+            }
+
+            const RouteLabel candidate{departure, tripId, position, index, waiting.price - priceHere};
+            const auto covers = [](const RouteLabel &a, const RouteLabel &b) {
+                return a.tripDeparture <= b.tripDeparture && a.basePrice <= b.basePrice;
+            };
+            if (std::ranges::any_of(m_routeBag, [&](const RouteLabel &other) { return covers(other, candidate); })) {
+                continue;
+            }
+            m_routeBag.removeIf([&](const RouteLabel &other) { return covers(candidate, other); });
+            m_routeBag.append(candidate);
+        }
+    }
+}
+
+Journey ParetoSearch::journeyFrom(qint32 index) const {
+    Journey journey;
+    for (; index >= 0 && m_labels[index].slot >= 0; index = m_labels[index].parent) {
+        const Label &current = m_labels[index];
+        const auto &route = m_index->route(current.slot);
+
+        JourneyLeg leg;
+        leg.route = route;
+        leg.tripId = current.tripId;
+        leg.tripDeparture = current.tripDeparture;
+        leg.boardStop = current.boardStop;
+        leg.alightStop = current.alightStop;
+        leg.departure = current.tripDeparture + route->arrivalOffset(current.boardStop);
+        leg.arrival = current.arrival;
+        leg.price = route->segmentPrice(current.boardStop + 1, current.alightStop + 1);
+        journey.legs.prepend(leg);
+    }
+    return journey;
+}
@@ -1,6 +1,5 @@
 #include "pricecalculator.h"
 #include "route.h"
-#include <algorithm>
 
 PriceCalculator::PriceCalculator() = default;
 
@@ -17,21 +16,11 @@ double PriceCalculator::calculateSegmentPrice(std::shared_ptr<Route> route,
         return 0.0;
     }
     
-    double price = 0.0;
-    auto stops = route->getAllStops();
-    
-    if (toStop > stops.size()) {
+    if (toStop > route->totalStops()) {
         return 0.0;
     }
     
-    const int endIndex = std::min(toStop, static_cast<int>(stops.size()));
-    for (int i = fromStop; i < endIndex; ++i) {
-        if (stops[i]) {
-            price += stops[i]->price;
-        }
-    }
-    
-    return price;
+    return route->segmentPrice(fromStop, toStop);
 }
 
 
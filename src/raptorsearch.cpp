@@ -0,0 +1,137 @@
+#include "raptorsearch.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+constexpr qint32 UNREACHED = std::numeric_limits<qint32>::max();
+
+} // namespace
+
+void RaptorSearch::reset(qsizetype cityCount, int rounds) {
+    m_cityCount = cityCount;
+    m_arrivals.fill(UNREACHED, cityCount * (rounds + 1));
+    m_labels.fill(Label(), cityCount * (rounds + 1));
+    m_best.fill(UNREACHED, cityCount);
+    m_queue.reset(cityCount, m_index->slotCount());
+}
+
+QVector<Journey> RaptorSearch::search(const CityRouteIndex &index, const Query &query) {
+    QVector<Journey> result;
+    m_index = &index;
+    const qsizetype cityCount = CityDictionary::instance().size();
+    if (query.from >= cityCount || query.to >= cityCount || query.from == query.to
+        || query.departAfter == Trip::INVALID_MINUTES || query.maxTransfers < 0) {
+        return result;
+    }
+
+    const int rounds = query.maxTransfers + 1;
+    reset(cityCount, rounds);
+    m_target = query.to;
+    const qint32 limit = static_cast<qint32>(std::min<qint64>(qint64(query.departAfter) + query.horizonMinutes,
+                                                              UNREACHED - 1));
+
+    arrival(0, query.from) = query.departAfter;
+    m_best[query.from] = query.departAfter;
+    m_queue.mark(query.from);
+
+    for (int round = 1; round <= rounds && !m_queue.isEmpty(); ++round) {
+        // Метки предыдущего раунда переносятся: на них опирается восстановление поездки
+        std::copy_n(m_arrivals.constBegin() + (round - 1) * m_cityCount, m_cityCount,
+                    m_arrivals.begin() + round * m_cityCount);
+        std::copy_n(m_labels.constBegin() + (round - 1) * m_cityCount, m_cityCount,
+                    m_labels.begin() + round * m_cityCount);
+
+        // Маршруты через отмеченные города - с самой ранней отмеченной остановки
+        m_queue.collectRoutes(*m_index);
+        m_queue.forEachRoute([&](qint32 slot, qint32 fromPosition) {
+            scanRoute(slot, fromPosition, round, query, limit);
+        });
+
+        // Поездка добавляется, только если она прибывает раньше поездок с меньшим числом пересадок
+        if (arrival(round, m_target) < arrival(round - 1, m_target)) {
+            result.append(journeyTo(m_target, round));
+        }
+    }
+    return result;
+}
+
+void RaptorSearch::scanRoute(qint32 slot, qint32 fromPosition, int round, const Query &query, qint32 limit) {
+    const Route &route = *m_index->route(slot);
+    const auto &cities = route.stopCityIds();
+    const auto &offsets = route.arrivalOffsets();
+
+    // Текущий рейс: самый ранний, на который можно сесть на уже пройденных остановках
+    bool onTrip = false;
+    qint32 tripDeparture = 0;
+    quint32 tripId = 0;
+    qint32 boardStop = -1;
+
+    for (qint32 position = fromPosition; position < cities.size(); ++position) {
+        const CityId city = cities[position];
+        if (city >= m_cityCount) {
+            continue;
+        }
+
+        if (onTrip) {
+            const qint64 reached = qint64(tripDeparture) + offsets[position];
+            if (reached < m_best[city] && reached < m_best[m_target]) {
+                arrival(round, city) = static_cast<qint32>(reached);
+                label(round, city) = {slot, boardStop, position, tripDeparture, tripId};
+                m_best[city] = static_cast<qint32>(reached);
+                m_queue.mark(city);
+            }
+        }
+
+        const qint32 previous = arrival(round - 1, city);
+        if (previous == UNREACHED) {
+            continue;
+        }
+        // Пересадка требует запаса времени; в городе отправления пассажир уже на месте
+        const qint64 ready = qint64(previous) + (label(round - 1, city).slot < 0 ? 0 : query.minTransferMinutes);
+        if (onTrip && ready > qint64(tripDeparture) + offsets[position]) {
+            continue;
+        }
+
+        quint32 nextId = 0;
+        const qint64 wanted = ready - offsets[position];
+        if (wanted > limit) {
+            continue;
+        }
+        const qint32 next = route.nextDeparture(static_cast<qint32>(std::max<qint64>(wanted, Trip::INVALID_MINUTES + 1)), &nextId);
+        if (next == Trip::INVALID_MINUTES || qint64(next) + offsets[position] > limit) {
+            continue;
+        }
+        if (!onTrip || next < tripDeparture) {
+            onTrip = true;
+            tripDeparture = next;
+            tripId = nextId;
+            boardStop = position;
+        }
+    }
+}
+
+Journey RaptorSearch::journeyTo(CityId city, int round) const {
+    Journey journey;
+    for (; round > 0; --round) {
+        const Label &current = m_labels[round * m_cityCount + city];
+        if (current.slot < 0) {
+            break;
+        }
+        const auto route = m_index->route(current.slot);
+
+        JourneyLeg leg;
+        leg.route = route;
+        leg.tripId = current.tripId;
+        leg.tripDeparture = current.tripDeparture;
+        leg.boardStop = current.boardStop;
+        leg.alightStop = current.alightStop;
+        leg.departure = current.tripDeparture + route->arrivalOffset(current.boardStop);
+        leg.arrival = current.tripDeparture + route->arrivalOffset(current.alightStop);
+        leg.price = route->segmentPrice(current.boardStop + 1, current.alightStop + 1);
+        journey.legs.prepend(leg);
+
+        city = route->stopCityId(current.boardStop);
+    }
+    return journey;
+}
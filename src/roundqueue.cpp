@@ -0,0 +1,32 @@
+#include "roundqueue.h"
+#include <algorithm>
+
+void RoundQueue::reset(qsizetype cityCount, qint32 slotCount) {
+    m_marked.fill(false, cityCount);
+    m_markedCities.clear();
+    m_queuedFrom.fill(-1, slotCount);
+    m_queuedSlots.clear();
+}
+
+void RoundQueue::mark(CityId city) {
+    if (!m_marked[city]) {
+        m_marked[city] = true;
+        m_markedCities.append(city);
+    }
+}
+
+void RoundQueue::collectRoutes(const CityRouteIndex &index) {
+    for (CityId city : std::as_const(m_markedCities)) {
+        m_marked[city] = false;
+        for (const auto &posting : index.postings(city)) {
+            qint32 &from = m_queuedFrom[posting.slot];
+            if (from < 0) {
+                m_queuedSlots.append(posting.slot);
+                from = posting.position;
+            } else {
+                from = std::min(from, posting.position);
+            }
+        }
+    }
+    m_markedCities.clear();
+}
@@ -1,111 +1,105 @@
 ﻿#include "route.h"
 #include "RouteException.h"
-#include "trip.h"
-
-Route::Route(const QString &name) : m_name(name) {}
-
-Route::~Route() {
-    while (m_head) {
-        auto next = m_head->next;
-        m_head->next.reset();
-        m_head = next;
-    }
-    m_tail.reset();
-
-    m_trips.clear();
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+// Маршруты создаются и из потоков разбора файлов
+quint64 Route::nextRevision() {
+    static std::atomic<quint64> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
 }
 
-
-Route::Route(const Route& other)
-    : m_name(other.m_name) {
-
-    for (auto stop = other.m_head; stop; stop = stop->next) {
-        addStop(stop->city, stop->durationMinutes, stop->price);
-    }
-
-    for (const auto& trip : other.m_trips) {
-        addTrip(trip->departure());
-    }
+Route::Route(const QString &name) : d(new RouteData) {
+    d->m_name = name;
+    touch();
 }
 
-Route& Route::operator=(const Route& other) {
-    if (this != &other) {
-        m_name = other.m_name;
-        m_head = nullptr;
-        m_tail = nullptr;
-        m_trips.clear();
-
-        for (auto stop = other.m_head; stop; stop = stop->next) {
-            addStop(stop->city, stop->durationMinutes, stop->price);
-        }
+QString Route::name() const { return d->m_name; }
 
-        for (const auto& trip : other.m_trips) {
-            addTrip(trip->departure());
-        }
-    }
-    return *this;
+void Route::addStop(const QString &city, int durationMinutes, double price, quint32 id) {
+    addStop(CityDictionary::instance().intern(city), durationMinutes, price, id);
 }
 
-QString Route::name() const { return m_name; }
+void Route::addStop(CityId city, int durationMinutes, double price, quint32 id) {
+    d->m_stopIds.append(id);
+    d->m_stopCityIds.append(city);
+    d->m_stopDurations.append(durationMinutes);
+    d->m_stopPrices.append(price);
+    d->m_cumulativeDurations.append(totalDuration() + durationMinutes);
+    d->m_cumulativePrices.append(totalPrice() + price);
+    touch();
+}
 
-void Route::addStop(const QString &city, int durationMinutes, double price) {
-    auto stop = std::make_shared<Stop>(city, durationMinutes, price);
-    if (!m_head) {
-        m_head = stop;
-        m_tail = stop;
-    } else {
-        m_tail->next = stop;
-        m_tail = stop;
+// Пересчитывает накопленные суммы начиная с fromPosition; левее них ничего не меняется
+void Route::updateCumulative(int fromPosition) {
+    RouteData &data = *d;
+    data.m_cumulativeDurations.resize(totalStops());
+    data.m_cumulativePrices.resize(totalStops());
+
+    int duration = fromPosition > 0 ? data.m_cumulativeDurations[fromPosition - 1] : 0;
+    double price = fromPosition > 0 ? data.m_cumulativePrices[fromPosition - 1] : 0;
+    for (int i = fromPosition; i < totalStops(); ++i) {
+        duration += data.m_stopDurations[i];
+        price += data.m_stopPrices[i];
+        data.m_cumulativeDurations[i] = duration;
+        data.m_cumulativePrices[i] = price;
     }
 }
 
 QString Route::info() const {
-    QString text = "Маршрут: " + m_name + "\n";
+    QString text = "Маршрут: " + d->m_name + "\n";
     text += "Общая длительность: " + QString::number(totalDuration()) + " мин\n";
     text += "Общая цена: " + QString::number(totalPrice()) + " руб\n";
 
     text += "\nОстановки:\n";
-    int stopNumber = 1;
-    for (auto s = m_head; s != nullptr;) {
+    for (int i = 0; i < totalStops(); ++i) {
         text += QString("%1. %2 - %3 мин, %4 руб\n")
-                    .arg(stopNumber)
-                    .arg(s->city)
-                    .arg(s->durationMinutes)
-                    .arg(s->price);
-        ++stopNumber;
-        s = s->next;
+                    .arg(i + 1)
+                    .arg(stopCity(i))
+                    .arg(d->m_stopDurations[i])
+                    .arg(d->m_stopPrices[i]);
     }
 
     return text;
 }
 
 std::shared_ptr<Stop> Route::firstStop() const {
-    return m_head;
+    const auto stops = getAllStops();
+    return stops.isEmpty() ? nullptr : stops.first();
 }
 
 int Route::totalDuration() const {
-    int sum = 0;
-    for (auto s = m_head; s; s = s->next) sum += s->durationMinutes;
-    return sum;
+    return d->m_cumulativeDurations.isEmpty() ? 0 : d->m_cumulativeDurations.last();
 }
 
 double Route::totalPrice() const {
-    double sum = 0;
-    for (auto s = m_head; s; s = s->next) sum += s->price;
-    return sum;
+    return d->m_cumulativePrices.isEmpty() ? 0 : d->m_cumulativePrices.last();
+}
+
+int Route::segmentDuration(int fromStop, int toStop) const {
+    if (fromStop < 0 || toStop > totalStops() || fromStop >= toStop) {
+        return 0;
+    }
+    return d->m_cumulativeDurations[toStop - 1] - (fromStop > 0 ? d->m_cumulativeDurations[fromStop - 1] : 0);
+}
+
+double Route::segmentPrice(int fromStop, int toStop) const {
+    if (fromStop < 0 || toStop > totalStops() || fromStop >= toStop) {
+        return 0;
+    }
+    return d->m_cumulativePrices[toStop - 1] - (fromStop > 0 ? d->m_cumulativePrices[fromStop - 1] : 0);
 }
 
 int Route::totalStops() const {
-    int count = 0;
-    for (auto s = m_head; s; s = s->next) count++;
-    return count;
+    return static_cast<int>(d->m_stopCityIds.size());
 }
 
 QString Route::detailedInfo() const {
     QString text;
 
     text += "═══════════════════════════════════════\n";
-    text += "МАРШРУТ: " + m_name.toUpper() + "\n";
+    text += "МАРШРУТ: " + d->m_name.toUpper() + "\n";
     text += "═══════════════════════════════════════\n\n";
 
     // Информация о маршруте
@@ -119,36 +113,43 @@ QString Route::detailedInfo() const {
     int accumulatedTime = 0;
     double accumulatedPrice = 0;
 
-    for (auto s = m_head; s != nullptr; s = s->next) {
+    for (int i = 0; i < totalStops(); ++i) {
         text += QString("   %1. %2\n")
                     .arg(stopNumber, 2)
-                    .arg(s->city);
+                    .arg(stopCity(i));
         text += QString("      +%1 мин (%2 мин)\n")
-                    .arg(s->durationMinutes)
-                    .arg(accumulatedTime + s->durationMinutes);
+                    .arg(d->m_stopDurations[i])
+                    .arg(accumulatedTime + d->m_stopDurations[i]);
         text += QString("      +%1 руб (%2 руб)\n")
-                    .arg(s->price)
-                    .arg(accumulatedPrice + s->price);
+                    .arg(d->m_stopPrices[i])
+                    .arg(accumulatedPrice + d->m_stopPrices[i]);
         ++stopNumber;
 
-        if (s->next) {
+        if (i + 1 < totalStops()) {
             text += "      ↓\n";
         }
 
-        accumulatedTime += s->durationMinutes;
-        accumulatedPrice += s->price;
+        accumulatedTime += d->m_stopDurations[i];
+        accumulatedPrice += d->m_stopPrices[i];
     }
 
     text += "\nЗАПЛАНИРОВАННЫЕ РЕЙСЫ:\n";
-    if (m_trips.empty()) {
+    if (tripCount() == 0 && tripRules().isEmpty()) {
         text += "   • Рейсов нет\n";
     } else {
-        for (int i = 0; i < m_trips.size(); ++i) {
-            const auto& trip = m_trips[i];
+        for (int i = 0; i < tripCount(); ++i) {
+            const Trip current = trip(i);
             text += QString("   %1. %2 → %3\n")
                         .arg(i + 1)
-                        .arg(trip->departure().toString("dd.MM.yyyy HH:mm"))
-                        .arg(trip->arrival(*this).toString("dd.MM.yyyy HH:mm"));
+                        .arg(current.departure().toString("dd.MM.yyyy HH:mm"))
+                        .arg(current.arrival(*this).toString("dd.MM.yyyy HH:mm"));
+        }
+    }
+
+    if (!tripRules().isEmpty()) {
+        text += "\nРАСПИСАНИЕ ПО ПРАВИЛАМ:\n";
+        for (int i = 0; i < tripRules().size(); ++i) {
+            text += QString("   %1. %2\n").arg(i + 1).arg(tripRules()[i].description());
         }
     }
 
@@ -156,42 +157,210 @@ QString Route::detailedInfo() const {
     return text;
 }
 
-void Route::addTrip(const QDateTime &departure) {
-    m_trips.append(std::make_shared<Trip>(departure));
+int Route::addTrip(const QDateTime &departure, quint32 id) {
+    return addTrip(Trip::toMinutes(departure), id);
 }
 
-QVector<std::shared_ptr<Trip>>& Route::trips() {
-    return m_trips;
+int Route::addTrip(qint32 departureMinutes, quint32 id) {
+    // Рейсы из файла обычно идут по порядку, и место находится в конце массива
+    const auto &departures = d->m_tripDepartures;
+    const auto position = static_cast<int>(std::upper_bound(departures.begin(), departures.end(), departureMinutes)
+                                           - departures.begin());
+    d->m_tripDepartures.insert(position, departureMinutes);
+    d->m_tripIds.insert(position, id);
+    d->m_serviceDays.setDay(ServiceCalendar::dayOfMinute(departureMinutes));
+    touch();
+    return position;
 }
 
-const QVector<std::shared_ptr<Trip>>& Route::trips() const {
-    return m_trips;
+void Route::insertTrip(int position, qint32 departureMinutes, quint32 id) {
+    const auto &departures = std::as_const(d)->m_tripDepartures;
+    if (position < 0 || position > tripCount()
+        || (position > 0 && departures[position - 1] > departureMinutes)
+        || (position < tripCount() && departures[position] < departureMinutes)) {
+        throw RouteException(QString("Invalid position for trip insert: %1. Total trips: %2")
+                                 .arg(position).arg(tripCount()));
+    }
+
+    d->m_tripDepartures.insert(position, departureMinutes);
+    d->m_tripIds.insert(position, id);
+    d->m_serviceDays.setDay(ServiceCalendar::dayOfMinute(departureMinutes));
+    touch();
 }
 
-void Route::insertStop(int position, const QString &city, int durationMinutes, double price) {
-    if (position < 0 || position > totalStops()) {
-        throw RouteException(QString("Invalid position for insert: %1. Total stops: %2")
-                                 .arg(position).arg(totalStops()));
+void Route::removeTrip(int position) {
+    if (position < 0 || position >= tripCount()) {
+        throw RouteException(QString("Invalid position for trip remove: %1. Total trips: %2")
+                                 .arg(position).arg(tripCount()));
     }
 
-    auto newStop = std::make_shared<Stop>(city, durationMinutes, price);
+    const qint32 day = ServiceCalendar::dayOfMinute(tripDeparture(position));
+    d->m_tripDepartures.remove(position);
+    d->m_tripIds.remove(position);
+    updateServiceDay(day);
+    touch();
+}
 
-    if (position == 0) {
-        newStop->next = m_head;
-        m_head = newStop;
-        if (!m_tail) m_tail = newStop;
-    } else if (position == totalStops()) {
-        m_tail->next = newStop;
-        m_tail = newStop;
+void Route::updateServiceDay(qint32 day) {
+    if (day == ServiceCalendar::INVALID_DAY) {
+        return;
+    }
+    const qint64 dayStart = qint64(day) * 24 * 60;
+    const auto [first, last] = tripRange(static_cast<qint32>(dayStart), static_cast<qint32>(std::min<qint64>(dayStart + 24 * 60, std::numeric_limits<qint32>::max())));
+    const QDate date = ServiceCalendar::dateOf(day);
+    const bool running = first < last || std::ranges::any_of(tripRules(), [&](const TripRule &rule) {
+        return rule.runsOn(date);
+    });
+    if (running) {
+        d->m_serviceDays.setDay(day);
     } else {
-        auto current = m_head;
-        for (int i = 0; i < position - 1; ++i) {
-            if (!current) throw RouteException("Invalid linked list state during insert");
-            current = current->next;
+        d->m_serviceDays.clearDay(day);
+    }
+}
+
+void Route::updateServiceDays() {
+    ServiceCalendar days;
+    for (qint32 departure : tripDepartures()) {
+        days.setDay(ServiceCalendar::dayOfMinute(departure));
+    }
+    for (const TripRule &rule : tripRules()) {
+        if (rule.isValid()) {
+            days |= rule.calendar();
+        }
+    }
+    d->m_serviceDays = days;
+}
+
+std::pair<int, int> Route::tripRange(qint32 fromMinutes, qint32 toMinutes) const {
+    const auto &departures = d->m_tripDepartures;
+    const auto first = std::lower_bound(departures.begin(), departures.end(), fromMinutes);
+    const auto last = std::lower_bound(first, departures.end(), toMinutes);
+    return {static_cast<int>(first - departures.begin()), static_cast<int>(last - departures.begin())};
+}
+
+void Route::addTripRule(const TripRule &rule) {
+    d->m_tripRules.append(rule);
+    if (rule.isValid()) {
+        d->m_serviceDays |= rule.calendar();
+    }
+    touch();
+}
+
+void Route::insertTripRule(int position, const TripRule &rule) {
+    if (position < 0 || position > tripRules().size()) {
+        throw RouteException(QString("Invalid position for trip rule insert: %1. Total rules: %2")
+                                 .arg(position).arg(tripRules().size()));
+    }
+    d->m_tripRules.insert(position, rule);
+    if (rule.isValid()) {
+        d->m_serviceDays |= rule.calendar();
+    }
+    touch();
+}
+
+void Route::setTripRule(int position, const TripRule &rule) {
+    if (position < 0 || position >= tripRules().size()) {
+        throw RouteException(QString("Invalid trip rule position: %1. Total rules: %2")
+                                 .arg(position).arg(tripRules().size()));
+    }
+    d->m_tripRules[position] = rule;
+    updateServiceDays();
+    touch();
+}
+
+void Route::removeTripRule(int position) {
+    if (position < 0 || position >= tripRules().size()) {
+        throw RouteException(QString("Invalid position for trip rule remove: %1. Total rules: %2")
+                                 .arg(position).arg(tripRules().size()));
+    }
+    d->m_tripRules.remove(position);
+    updateServiceDays();
+    touch();
+}
+
+QVector<Trip> Route::trips(qint32 fromMinutes, qint32 toMinutes) const {
+    QVector<Trip> result;
+    if (fromMinutes >= toMinutes) {
+        return result;
+    }
+
+    const auto [first, last] = tripRange(fromMinutes, toMinutes);
+    QVector<qint32> departures(tripDepartures().begin() + first, tripDepartures().begin() + last);
+    const qsizetype explicitCount = departures.size();
+    for (const TripRule &rule : tripRules()) {
+        rule.expand(fromMinutes, toMinutes, departures);
+    }
+    if (departures.size() == explicitCount) {
+        result.reserve(explicitCount);
+        for (int t = first; t < last; ++t) {
+            result.append(trip(t));
         }
-        newStop->next = current->next;
-        current->next = newStop;
+        return result;
     }
+
+    // Отдельные рейсы сохраняют свои id; рейсы по правилам добавляются между ними по времени
+    QVector<qint32> generated(departures.begin() + explicitCount, departures.end());
+    std::sort(generated.begin(), generated.end());
+    result.reserve(departures.size());
+    int t = first;
+    for (qint32 departure : generated) {
+        while (t < last && tripDeparture(t) <= departure) {
+            result.append(trip(t++));
+        }
+        result.append(Trip::fromMinutes(departure));
+    }
+    while (t < last) {
+        result.append(trip(t++));
+    }
+    return result;
+}
+
+bool Route::hasDeparturesBetween(qint32 fromMinutes, qint32 toMinutes) const {
+    if (const auto [first, last] = tripRange(fromMinutes, toMinutes); first < last) {
+        return true;
+    }
+    return std::ranges::any_of(tripRules(), [&](const TripRule &rule) {
+        return rule.hasDeparturesBetween(fromMinutes, toMinutes);
+    });
+}
+
+qint32 Route::nextDeparture(qint32 fromMinutes, quint32 *tripId) const {
+    const auto &departures = tripDepartures();
+    const auto it = std::lower_bound(departures.begin(), departures.end(), fromMinutes);
+    qint32 best = it != departures.end() ? *it : Trip::INVALID_MINUTES;
+    quint32 bestId = it != departures.end() ? tripIds()[it - departures.begin()] : 0;
+
+    // При равном времени предпочтение у отдельного рейса
+    for (const TripRule &rule : tripRules()) {
+        const qint32 departure = rule.nextDeparture(fromMinutes);
+        if (departure != Trip::INVALID_MINUTES && (best == Trip::INVALID_MINUTES || departure < best)) {
+            best = departure;
+            bestId = 0;
+        }
+    }
+
+    if (tripId) {
+        *tripId = bestId;
+    }
+    return best;
+}
+
+void Route::insertStop(int position, const QString &city, int durationMinutes, double price, quint32 id) {
+    insertStop(position, CityDictionary::instance().intern(city), durationMinutes, price, id);
+}
+
+void Route::insertStop(int position, CityId city, int durationMinutes, double price, quint32 id) {
+    if (position < 0 || position > totalStops()) {
+        throw RouteException(QString("Invalid position for insert: %1. Total stops: %2")
+                                 .arg(position).arg(totalStops()));
+    }
+
+    d->m_stopIds.insert(position, id);
+    d->m_stopCityIds.insert(position, city);
+    d->m_stopDurations.insert(position, durationMinutes);
+    d->m_stopPrices.insert(position, price);
+    updateCumulative(position);
+    touch();
 }
 
 void Route::removeStop(int position) {
@@ -200,19 +369,12 @@ void Route::removeStop(int position) {
                                  .arg(position).arg(totalStops()));
     }
 
-    if (position == 0) {
-        m_head = m_head->next;
-        if (!m_head) m_tail = nullptr;
-    } else {
-        auto current = m_head;
-        for (int i = 0; i < position - 1; ++i) {
-            if (!current) throw RouteException("Invalid linked list state during remove");
-            current = current->next;
-        }
-        if (!current->next) throw RouteException("Invalid linked list state during remove");
-        current->next = current->next->next;
-        if (!current->next) m_tail = current;
-    }
+    d->m_stopIds.remove(position);
+    d->m_stopCityIds.remove(position);
+    d->m_stopDurations.remove(position);
+    d->m_stopPrices.remove(position);
+    updateCumulative(position);
+    touch();
 }
 
 std::shared_ptr<Stop> Route::getStop(int position) const {
@@ -220,19 +382,19 @@ std::shared_ptr<Stop> Route::getStop(int position) const {
         return nullptr;
     }
 
-    auto current = m_head;
-    int i = 0;
-    while (i < position && current) {
-        current = current->next;
-        ++i;
-    }
-    return current;
+    auto stop = std::make_shared<Stop>(stopCity(position), d->m_stopDurations[position], d->m_stopPrices[position]);
+    stop->id = d->m_stopIds[position];
+    return stop;
 }
 
 QVector<std::shared_ptr<Stop>> Route::getAllStops() const {
     QVector<std::shared_ptr<Stop>> stops;
-    for (auto current = m_head; current; current = current->next) {
-        stops.append(current);
+    stops.reserve(totalStops());
+    for (int i = 0; i < totalStops(); ++i) {
+        stops.append(getStop(i));
+        if (i > 0) {
+            stops[i - 1]->next = stops[i];
+        }
     }
     return stops;
 }
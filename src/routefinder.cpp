@@ -1,149 +1,501 @@
 #include "routefinder.h"
 #include "company.h"
+#include "filedatabase.h"
 #include "trip.h"
+#include <QtConcurrent>
+#include <QThreadPool>
+
+namespace {
+
+constexpr qint64 MINUTES_PER_DAY = 24 * 60;
+
+// Непрерывный диапазон пар пакетного запроса
+struct PairChunk {
+    qsizetype first = 0;
+    qsizetype count = 0;
+};
+
+} // namespace
 
 RouteFinder::RouteFinder() = default;
 
-QVector<std::shared_ptr<Route>> RouteFinder::findRoutes(const QString& fromCity, 
-                                                          const QString& toCity,
-                                                          const QVector<Company>& companies) const {
-    QVector<std::shared_ptr<Route>> result;
-    auto allRoutes = getAllRoutes(companies);
-    
-    for (const auto& route : allRoutes) {
-        int fromPos = findCityPosition(route, fromCity);
-        int toPos = findCityPosition(route, toCity);
-        
-        if (fromPos >= 0 && toPos >= 0 && fromPos < toPos) {
-            result.append(route);
-        }
+RouteFinder::~RouteFinder() {
+    QObject::disconnect(m_changedConnection);
+    QObject::disconnect(m_destroyedConnection);
+}
+
+void RouteFinder::setDatabase(const FileDatabase* database) {
+    if (m_database == database) {
+        return;
     }
-    
+    QObject::disconnect(m_changedConnection);
+    QObject::disconnect(m_destroyedConnection);
+    m_database = database;
+    m_indexStale = true;
+    if (database) {
+        m_changedConnection = QObject::connect(database, &FileDatabase::companiesChanged, [this]() {
+            m_indexStale = true;
+        });
+        m_destroyedConnection = QObject::connect(database, &QObject::destroyed, [this]() {
+            m_database = nullptr;
+            m_indexStale = true;
+        });
+    }
+}
+
+void RouteFinder::invalidateIndex() {
+    m_indexStale = true;
+}
+
+void RouteFinder::setCacheCapacity(qsizetype entries) {
+    m_cache.setMaxCost(std::max<qsizetype>(entries, 0));
+}
+
+RouteFinder::CacheStats RouteFinder::cacheStats() const {
+    CacheStats stats = m_cacheStats;
+    stats.size = m_cache.size();
+    stats.capacity = m_cache.maxCost();
+    return stats;
+}
+
+void RouteFinder::resetCacheStats() {
+    m_cacheStats = CacheStats();
+}
+
+const RouteFinder::CachedResult* RouteFinder::cachedResult(const QueryKey& key) const {
+    // object() переносит найденную запись в начало очереди вытеснения
+    const CachedResult* cached = m_cache.object(key);
+    if (cached) {
+        ++m_cacheStats.hits;
+    } else {
+        ++m_cacheStats.misses;
+    }
+    return cached;
+}
+
+void RouteFinder::storeResult(const QueryKey& key, CachedResult result) const {
+    if (m_cache.maxCost() > 0) {
+        m_cache.insert(key, new CachedResult(std::move(result)));
+    }
+}
+
+QVector<std::shared_ptr<const Route>> RouteFinder::findRoutes(const QString& fromCity, 
+                                                                const QString& toCity,
+                                                                const QVector<Company>& companies) const {
+    QVector<std::shared_ptr<const Route>> result;
+    // Города переводятся в номера один раз, дальше сравниваются только целые числа
+    const CityId from = CityDictionary::instance().find(fromCity);
+    const CityId to = CityDictionary::instance().find(toCity);
+    if (from == CityDictionary::InvalidCityId || to == CityDictionary::InvalidCityId) {
+        return result;
+    }
+
+    // Переиндексируются только измененные маршруты, затем пересекаются списки двух городов.
+    // Синхронизация идет до кэша: ответ должен относиться к переданным компаниям
+    syncIndex(companies);
+    const QueryKey key{m_datasetVersion, QueryKind::Routes, from, to};
+    if (const CachedResult* cached = cachedResult(key)) {
+        return cached->routes;
+    }
+
+    result = m_cityIndex.routesBetween(from, to);
+    storeResult(key, {result, {}});
     return result;
 }
 
-QVector<QVector<std::shared_ptr<Route>>> RouteFinder::findRoutesWithTransfers(
+QVector<Journey> RouteFinder::findRoutesWithTransfers(
     const QString& fromCity,
     const QString& toCity,
+    const QDateTime& departAfter,
     const QVector<Company>& companies,
-    int) const {
-    QVector<QVector<std::shared_ptr<Route>>> result;
-    // Упрощенная реализация поиска с пересадками
-    auto directRoutes = findRoutes(fromCity, toCity, companies);
-    for (const auto& route : directRoutes) {
-        result.append({route});
+    int maxTransfers,
+    int minTransferMinutes) const {
+    RaptorSearch::Query query;
+    query.from = CityDictionary::instance().find(fromCity);
+    query.to = CityDictionary::instance().find(toCity);
+    query.departAfter = Trip::toMinutes(departAfter);
+    query.maxTransfers = maxTransfers;
+    query.minTransferMinutes = std::max(minTransferMinutes, 0);
+    if (query.from == CityDictionary::InvalidCityId || query.to == CityDictionary::InvalidCityId
+        || query.departAfter == Trip::INVALID_MINUTES) {
+        return {};
     }
-    return result;
+
+    syncIndex(companies);
+    const QueryKey key{m_datasetVersion, QueryKind::Transfers, query.from, query.to, query.departAfter,
+                       query.maxTransfers, query.minTransferMinutes};
+    if (const CachedResult* cached = cachedResult(key)) {
+        return cached->journeys;
+    }
+
+    QVector<Journey> journeys;
+    if (m_connectivity.isReachable(query.from, query.to, maxTransfers)) {
+        journeys = m_raptor.search(m_cityIndex, query);
+    }
+    storeResult(key, {{}, journeys});
+    return journeys;
 }
 
-QVector<std::shared_ptr<Route>> RouteFinder::findRoutesByDate(const QDate& date,
-                                                                const QVector<Company>& companies) const {
-    QVector<std::shared_ptr<Route>> result;
-    auto allRoutes = getAllRoutes(companies);
-    
-    for (const auto& route : allRoutes) {
-        for (const auto& trip : route->trips()) {
-            if (trip && trip->departure().date() == date) {
-                result.append(route);
-                break;
-            }
-        }
+QVector<Journey> RouteFinder::findProfile(
+    const QString& fromCity,
+    const QString& toCity,
+    const QDateTime& windowStart,
+    const QDateTime& windowEnd,
+    const QVector<Company>& companies,
+    int minTransferMinutes) const {
+    const CityId from = CityDictionary::instance().find(fromCity);
+    const CityId to = CityDictionary::instance().find(toCity);
+    const qint32 start = Trip::toMinutes(windowStart);
+    const qint32 end = Trip::toMinutes(windowEnd);
+    if (from == CityDictionary::InvalidCityId || to == CityDictionary::InvalidCityId
+        || start == Trip::INVALID_MINUTES || end == Trip::INVALID_MINUTES || start > end) {
+        return {};
     }
-    
+
+    // Поездки, начатые в конце окна, могут закончиться на следующие сутки. Сеть отбирает связи
+    // по их собственному отправлению, поэтому в нее попадают и рейсы, вышедшие до начала окна
+    // и проходящие fromCity внутри него
+    const qint32 horizon = static_cast<qint32>(std::min<qint64>(qint64(end) + MINUTES_PER_DAY, ConnectionScan::UNREACHED - 1));
+    syncIndex(companies);
+    return connectionsCovering(companies, start, horizon).profile(from, to, start, end, minTransferMinutes);
+}
+
+Journey RouteFinder::findEarliestArrival(
+    const QString& fromCity,
+    const QString& toCity,
+    const QDateTime& departAfter,
+    const QVector<Company>& companies,
+    int minTransferMinutes) const {
+    const CityId from = CityDictionary::instance().find(fromCity);
+    const CityId to = CityDictionary::instance().find(toCity);
+    const qint32 start = Trip::toMinutes(departAfter);
+    if (from == CityDictionary::InvalidCityId || to == CityDictionary::InvalidCityId || start == Trip::INVALID_MINUTES) {
+        return {};
+    }
+
+    const qint32 horizon = static_cast<qint32>(std::min<qint64>(qint64(start) + MINUTES_PER_DAY, ConnectionScan::UNREACHED - 1));
+    syncIndex(companies);
+    return connectionsCovering(companies, start, horizon).earliestArrival(from, to, start, std::max(minTransferMinutes, 0));
+}
+
+const ConnectionScan& RouteFinder::connectionsCovering(const QVector<Company>& companies, qint32 fromMinutes,
+                                                       qint32 toMinutes) const {
+    if (!m_connectionsValid || !m_connections.covers(fromMinutes, toMinutes)) {
+        m_connections = ConnectionScan(companies, fromMinutes, toMinutes);
+        m_connectionsValid = true;
+    }
+    return m_connections;
+}
+
+QVector<Journey> RouteFinder::findParetoJourneys(
+    const QString& fromCity,
+    const QString& toCity,
+    const QDateTime& departAfter,
+    const QVector<Company>& companies,
+    int maxTransfers,
+    int minTransferMinutes,
+    double maxPrice,
+    const QDateTime& arriveBefore) const {
+    ParetoSearch::Query query;
+    query.from = CityDictionary::instance().find(fromCity);
+    query.to = CityDictionary::instance().find(toCity);
+    query.departAfter = Trip::toMinutes(departAfter);
+    query.maxTransfers = maxTransfers;
+    query.minTransferMinutes = std::max(minTransferMinutes, 0);
+    if (maxPrice >= 0) {
+        query.maxPrice = maxPrice;
+    }
+    if (arriveBefore.isValid()) {
+        query.arriveBefore = Trip::toMinutes(arriveBefore);
+    }
+    // Граница прибытия вне диапазона минут не должна превратиться в отсутствие границы
+    if (query.from == CityDictionary::InvalidCityId || query.to == CityDictionary::InvalidCityId
+        || query.departAfter == Trip::INVALID_MINUTES
+        || (arriveBefore.isValid() && query.arriveBefore == Trip::INVALID_MINUTES)) {
+        return {};
+    }
+
+    syncIndex(companies);
+    if (!m_connectivity.isReachable(query.from, query.to, maxTransfers)) {
+        return {};
+    }
+    return m_pareto.search(m_cityIndex, query);
+}
+
+QVector<ReachableCity> RouteFinder::findReachableCities(
+    const QString& fromCity,
+    const QDateTime& departAfter,
+    const QVector<Company>& companies,
+    int timeBudgetMinutes,
+    double fareBudget,
+    ReachOrder order,
+    int maxTransfers,
+    int minTransferMinutes) const {
+    ParetoSearch::Query query;
+    query.from = CityDictionary::instance().find(fromCity);
+    query.departAfter = Trip::toMinutes(departAfter);
+    query.maxTransfers = maxTransfers;
+    query.minTransferMinutes = std::max(minTransferMinutes, 0);
+    if (query.from == CityDictionary::InvalidCityId || query.departAfter == Trip::INVALID_MINUTES) {
+        return {};
+    }
+    // Бюджет времени заменяет горизонт поиска по умолчанию
+    if (timeBudgetMinutes >= 0) {
+        query.horizonMinutes = timeBudgetMinutes;
+    }
+    if (fareBudget >= 0) {
+        query.maxPrice = fareBudget;
+    }
+
+    syncIndex(companies);
+    auto result = m_pareto.reachable(m_cityIndex, query);
+    std::ranges::sort(result, [order](const ReachableCity& a, const ReachableCity& b) {
+        if (order == ReachOrder::ByPrice && a.lowestPrice != b.lowestPrice) {
+            return a.lowestPrice < b.lowestPrice;
+        }
+        return a.earliestArrival != b.earliestArrival ? a.earliestArrival < b.earliestArrival
+                                                       : a.lowestPrice < b.lowestPrice;
+    });
     return result;
 }
 
-QVector<std::shared_ptr<Route>> RouteFinder::findRoutesByPriceRange(double minPrice,
-                                                                      double maxPrice,
+QVector<std::shared_ptr<const Route>> RouteFinder::findRoutesByDate(const QDate& date,
                                                                       const QVector<Company>& companies) const {
-    QVector<std::shared_ptr<Route>> result;
-    auto allRoutes = getAllRoutes(companies);
-    
-    for (const auto& route : allRoutes) {
-        double price = route->totalPrice();
-        if (price >= minPrice && price <= maxPrice) {
+    if (!date.isValid()) {
+        return {};
+    }
+
+    // Сутки даты - двоичный поиск по индексу отправлений
+    const qint64 start = ServiceCalendar::dayNumber(date) * MINUTES_PER_DAY;
+    if (start < std::numeric_limits<qint32>::min() || start + MINUTES_PER_DAY > std::numeric_limits<qint32>::max()) {
+        return {};
+    }
+    syncIndex(companies);
+    QVector<qint32> found;
+    m_rangeIndex.slotsDepartingBetween(m_cityIndex, static_cast<qint32>(start),
+                                       static_cast<qint32>(start + MINUTES_PER_DAY), found);
+    return m_cityIndex.routesOf(found);
+}
+
+QVector<std::shared_ptr<const Route>> RouteFinder::findRoutesByTimeRange(const QDateTime& start,
+                                                                           const QDateTime& end,
+                                                                           const QVector<Company>& companies) const {
+    const qint32 from = Trip::toMinutes(start);
+    const qint32 to = Trip::toMinutes(end);
+    if (from == Trip::INVALID_MINUTES || to == Trip::INVALID_MINUTES) {
+        return {};
+    }
+
+    syncIndex(companies);
+    QVector<qint32> found;
+    m_rangeIndex.slotsDepartingBetween(m_cityIndex, from, to, found);
+    return m_cityIndex.routesOf(found);
+}
+
+QVector<std::shared_ptr<const Route>> RouteFinder::findRoutesByDates(const ServiceCalendar& days,
+                                                                       const QVector<Company>& companies) const {
+    QVector<std::shared_ptr<const Route>> result;
+    if (days.isEmpty()) {
+        return result;
+    }
+
+    for (const auto& route : getAllRoutes(companies)) {
+        if (route->serviceDays().intersects(days)) {
             result.append(route);
         }
     }
-    
     return result;
 }
 
-std::shared_ptr<Route> RouteFinder::findFastestRoute(const QString& fromCity,
-                                                      const QString& toCity,
-                                                      const QVector<Company>& companies) const {
-    auto routes = findRoutes(fromCity, toCity, companies);
-    if (routes.isEmpty()) {
+QVector<std::shared_ptr<const Route>> RouteFinder::findRoutesByPriceRange(double minPrice,
+                                                                            double maxPrice,
+                                                                            const QVector<Company>& companies) const {
+    syncIndex(companies);
+    QVector<qint32> found;
+    m_rangeIndex.slotsInPriceRange(minPrice, maxPrice, found);
+    return m_cityIndex.routesOf(found);
+}
+
+std::shared_ptr<const Route> RouteFinder::findFastestRoute(const QString& fromCity,
+                                                            const QString& toCity,
+                                                            const QVector<Company>& companies) const {
+    return findBestRoute(fromCity, toCity, RouteCriterion::Fastest, companies);
+}
+
+std::shared_ptr<const Route> RouteFinder::findCheapestRoute(const QString& fromCity,
+                                                             const QString& toCity,
+                                                             const QVector<Company>& companies) const {
+    return findBestRoute(fromCity, toCity, RouteCriterion::Cheapest, companies);
+}
+
+std::shared_ptr<const Route> RouteFinder::findBestRoute(const QString& fromCity,
+                                                        const QString& toCity,
+                                                        RouteCriterion criterion,
+                                                        const QVector<Company>& companies) const {
+    const CityId from = CityDictionary::instance().find(fromCity);
+    const CityId to = CityDictionary::instance().find(toCity);
+    if (from == CityDictionary::InvalidCityId || to == CityDictionary::InvalidCityId) {
         return nullptr;
     }
-    
-    std::shared_ptr<Route> fastest = routes.first();
-    int minDuration = fastest->totalDuration();
-    
-    for (const auto& route : routes) {
-        int duration = route->totalDuration();
-        if (duration < minDuration) {
-            minDuration = duration;
-            fastest = route;
+
+    syncIndex(companies);
+    const QueryKey key{m_datasetVersion, criterion == RouteCriterion::Fastest ? QueryKind::Fastest : QueryKind::Cheapest,
+                       from, to};
+    if (const CachedResult* cached = cachedResult(key)) {
+        return cached->routes.isEmpty() ? nullptr : cached->routes.first();
+    }
+
+    QVector<qint32> found;
+    std::shared_ptr<const Route> best = bestDirectRoute(from, to, criterion, found);
+    storeResult(key, {best ? QVector<std::shared_ptr<const Route>>{best} : QVector<std::shared_ptr<const Route>>(), {}});
+    return best;
+}
+
+QVector<std::shared_ptr<const Route>> RouteFinder::findRoutesBatch(const QVector<OdPair>& pairs,
+                                                                   RouteCriterion criterion,
+                                                                   const QVector<Company>& companies) const {
+    // Дальше индекс и матрица связности только читаются, поэтому потоки работают без блокировок
+    syncIndex(companies);
+
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    if (pairs.size() < PARALLEL_BATCH_MIN_PAIRS || threadCount < 2) {
+        QVector<std::shared_ptr<const Route>> result;
+        result.reserve(pairs.size());
+        QVector<qint32> found;
+        for (const auto& pair : pairs) {
+            result.append(bestDirectRoute(pair, criterion, found));
         }
+        return result;
     }
-    
-    return fastest;
+
+    // Части по несколько на поток выравнивают нагрузку; буфер заводится один раз на часть
+    const qsizetype chunkCount = std::min<qsizetype>(pairs.size(), qsizetype(threadCount) * 4);
+    QVector<PairChunk> chunks;
+    chunks.reserve(chunkCount);
+    for (qsizetype i = 0; i < chunkCount; ++i) {
+        const qsizetype first = pairs.size() * i / chunkCount;
+        chunks.append(PairChunk{first, pairs.size() * (i + 1) / chunkCount - first});
+    }
+
+    const QList<QVector<std::shared_ptr<const Route>>> parts = QtConcurrent::blockingMapped(chunks,
+        [this, &pairs, criterion](const PairChunk& chunk) {
+            QVector<std::shared_ptr<const Route>> part;
+            part.reserve(chunk.count);
+            QVector<qint32> found;
+            for (qsizetype i = chunk.first; i < chunk.first + chunk.count; ++i) {
+                part.append(bestDirectRoute(pairs[i], criterion, found));
+            }
+            return part;
+        });
+
+    // Части идут в порядке входа, поэтому склейка сохраняет порядок пар
+    QVector<std::shared_ptr<const Route>> result;
+    result.reserve(pairs.size());
+    for (const auto& part : parts) {
+        result.append(part);
+    }
+    return result;
+}
+
+std::shared_ptr<const Route> RouteFinder::bestDirectRoute(const OdPair& pair,
+                                                          RouteCriterion criterion,
+                                                          QVector<qint32>& found) const {
+    return bestDirectRoute(CityDictionary::instance().find(pair.fromCity),
+                           CityDictionary::instance().find(pair.toCity), criterion, found);
 }
 
-std::shared_ptr<Route> RouteFinder::findCheapestRoute(const QString& fromCity,
-                                                       const QString& toCity,
-                                                       const QVector<Company>& companies) const {
-    auto routes = findRoutes(fromCity, toCity, companies);
-    if (routes.isEmpty()) {
+std::shared_ptr<const Route> RouteFinder::bestDirectRoute(CityId from,
+                                                          CityId to,
+                                                          RouteCriterion criterion,
+                                                          QVector<qint32>& found) const {
+    // Неизвестный город не попадает в матрицу, и hasDirect вернет false
+    if (!m_connectivity.hasDirect(from, to)) {
         return nullptr;
     }
-    
-    std::shared_ptr<Route> cheapest = routes.first();
-    double minPrice = cheapest->totalPrice();
-    
-    for (const auto& route : routes) {
-        double price = route->totalPrice();
-        if (price < minPrice) {
-            minPrice = price;
-            cheapest = route;
+
+    // При равенстве остается первый маршрут в порядке компаний
+    m_cityIndex.slotsBetween(from, to, found);
+    std::shared_ptr<const Route> best;
+    double bestValue = 0;
+    for (qint32 slot : found) {
+        const auto& route = m_cityIndex.route(slot);
+        const double value = criterion == RouteCriterion::Fastest ? route->totalDuration() : route->totalPrice();
+        if (!best || value < bestValue) {
+            bestValue = value;
+            best = route;
         }
     }
-    
-    return cheapest;
+    return best;
 }
 
 bool RouteFinder::hasDirectRoute(const QString& fromCity,
                                   const QString& toCity,
                                   const QVector<Company>& companies) const {
-    return !findRoutes(fromCity, toCity, companies).isEmpty();
+    const CityId from = CityDictionary::instance().find(fromCity);
+    const CityId to = CityDictionary::instance().find(toCity);
+    if (from == CityDictionary::InvalidCityId || to == CityDictionary::InvalidCityId) {
+        return false;
+    }
+
+    syncIndex(companies);
+    return m_connectivity.hasDirect(from, to);
+}
+
+bool RouteFinder::hasConnection(const QString& fromCity,
+                                const QString& toCity,
+                                const QVector<Company>& companies,
+                                int maxTransfers) const {
+    const CityId from = CityDictionary::instance().find(fromCity);
+    const CityId to = CityDictionary::instance().find(toCity);
+    if (from == CityDictionary::InvalidCityId || to == CityDictionary::InvalidCityId) {
+        return false;
+    }
+
+    syncIndex(companies);
+    return m_connectivity.isReachable(from, to, maxTransfers);
 }
 
-bool RouteFinder::routeContainsCity(std::shared_ptr<Route> route, const QString& city) const {
+bool RouteFinder::routeContainsCity(std::shared_ptr<const Route> route, const QString& city) const {
     if (!route) return false;
     
-    auto stops = route->getAllStops();
-    return std::ranges::any_of(stops, [&city](const auto& stop) {
-        return stop && stop->city == city;
-    });
+    const CityId id = CityDictionary::instance().find(city);
+    return id != CityDictionary::InvalidCityId && route->stopCityIds().contains(id);
 }
 
-int RouteFinder::findCityPosition(std::shared_ptr<Route> route, const QString& city) const {
+int RouteFinder::findCityPosition(std::shared_ptr<const Route> route, const QString& city) const {
     if (!route) return -1;
     
-    auto stops = route->getAllStops();
-    qsizetype i = 0;
-    for (const auto& stop : stops) {
-        if (stop && stop->city == city) {
-            return static_cast<int>(i);
+    const CityId id = CityDictionary::instance().find(city);
+    return id == CityDictionary::InvalidCityId ? -1 : static_cast<int>(route->stopCityIds().indexOf(id));
+}
+
+void RouteFinder::syncIndex(const QVector<Company>& companies) const {
+    // Писатели публикуют новый список, поэтому тот же список той же версии базы уже проиндексирован
+    // и обходить его маршруты незачем
+    const quint64 generation = m_database ? m_database->generation() : 0;
+    if (!m_indexStale && generation == m_indexedGeneration && companies.size() == m_indexedCompanies.size()
+        && companies.constData() == m_indexedCompanies.constData()) {
+        return;
+    }
+    m_indexedCompanies = companies;
+    m_indexedGeneration = generation;
+    m_indexStale = false;
+
+    // Сеть связей для профилей и кэш ответов относятся к прежним маршрутам и устаревают вместе с индексом
+    if (m_cityIndex.sync(companies)) {
+        m_connectionsValid = false;
+        ++m_datasetVersion;
+        if (!m_cache.isEmpty()) {
+            m_cache.clear();
+            ++m_cacheStats.invalidations;
         }
-        ++i;
     }
-    return -1;
+    m_connectivity.update(m_cityIndex);
+    m_rangeIndex.update(m_cityIndex);
 }
 
-QVector<std::shared_ptr<Route>> RouteFinder::getAllRoutes(const QVector<Company>& companies) const {
-    QVector<std::shared_ptr<Route>> allRoutes;
+QVector<std::shared_ptr<const Route>> RouteFinder::getAllRoutes(const QVector<Company>& companies) const {
+    QVector<std::shared_ptr<const Route>> allRoutes;
     for (const auto& company : companies) {
         for (const auto& route : company.routes()) {
             allRoutes.append(route);
@@ -0,0 +1,160 @@
+#include "routerangeindex.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Добавления вливаются в основной массив, когда их больше корня из его размера, но не меньше
+// этого числа: и вставка в добавления, и сжатие в пересчете на запись стоят порядка корня
+constexpr qsizetype MIN_RECENT_ENTRIES = 256;
+
+// Оба массива упорядочены
+template<typename Entry>
+void mergeInto(QVector<Entry> &target, const QVector<Entry> &added) {
+    const qsizetype middle = target.size();
+    target.append(added);
+    std::inplace_merge(target.begin(), target.begin() + middle, target.end());
+}
+
+} // namespace
+
+void RouteRangeIndex::update(const CityRouteIndex& index) {
+    if (index.syncNumber() == m_syncNumber) {
+        return;
+    }
+    if (index.syncNumber() != m_syncNumber + 1) {
+        rebuild(index);
+        return;
+    }
+
+    m_syncNumber = index.syncNumber();
+    if (!index.touchedSlots().isEmpty()) {
+        replaceSlots(index, index.touchedSlots());
+    }
+}
+
+void RouteRangeIndex::rebuild(const CityRouteIndex& index) {
+    m_syncNumber = index.syncNumber();
+    m_departures.clear();
+    m_recentDepartures.clear();
+    m_prices.clear();
+    m_recentPrices.clear();
+    m_slotStamps.clear();
+    m_slotEntries.clear();
+    m_deadEntries = 0;
+    m_ruleSlots.clear();
+
+    QVector<qint32> all;
+    all.reserve(index.slotCount());
+    for (qint32 slot = 0; slot < index.slotCount(); ++slot) {
+        all.append(slot);
+    }
+    replaceSlots(index, all);
+}
+
+void RouteRangeIndex::replaceSlots(const CityRouteIndex& index, const QVector<qint32>& changed) {
+    if (m_slotStamps.size() < index.slotCount()) {
+        m_slotStamps.resize(index.slotCount(), 0);
+        m_slotEntries.resize(index.slotCount(), 0);
+    }
+
+    QVector<Departure> departures;
+    QVector<Price> prices;
+    for (qint32 slot : changed) {
+        // Прежние записи маршрута умирают вместе со сменой метки
+        const quint32 stamp = ++m_slotStamps[slot];
+        m_deadEntries += m_slotEntries[slot];
+        m_slotEntries[slot] = 0;
+
+        const auto &route = index.route(slot);
+        const qsizetype rulePosition = std::lower_bound(m_ruleSlots.begin(), m_ruleSlots.end(), slot) - m_ruleSlots.begin();
+        const bool hadRules = rulePosition < m_ruleSlots.size() && m_ruleSlots[rulePosition] == slot;
+        const bool hasRules = route && !route->tripRules().isEmpty();
+        if (hasRules && !hadRules) {
+            m_ruleSlots.insert(rulePosition, slot);
+        } else if (!hasRules && hadRules) {
+            m_ruleSlots.remove(rulePosition);
+        }
+        if (!route) {
+            continue;
+        }
+
+        for (qint32 minutes : route->tripDepartures()) {
+            departures.append(Departure{minutes, slot, stamp});
+        }
+        prices.append(Price{route->totalPrice(), slot, stamp});
+        m_slotEntries[slot] = route->tripDepartures().size() + 1;
+    }
+
+    std::sort(departures.begin(), departures.end());
+    std::sort(prices.begin(), prices.end());
+    mergeInto(m_recentDepartures, departures);
+    mergeInto(m_recentPrices, prices);
+
+    const qsizetype mainEntries = m_departures.size() + m_prices.size();
+    const qsizetype recentEntries = m_recentDepartures.size() + m_recentPrices.size();
+    const auto recentLimit = std::max(MIN_RECENT_ENTRIES, static_cast<qsizetype>(std::sqrt(double(mainEntries))));
+    if (recentEntries > recentLimit || m_deadEntries > (mainEntries + recentEntries) / 4) {
+        compact();
+    }
+}
+
+void RouteRangeIndex::compact() {
+    const auto dead = [this](const auto &entry) { return !isLive(entry.slot, entry.stamp); };
+    m_departures.removeIf(dead);
+    m_recentDepartures.removeIf(dead);
+    m_prices.removeIf(dead);
+    m_recentPrices.removeIf(dead);
+
+    mergeInto(m_departures, m_recentDepartures);
+    mergeInto(m_prices, m_recentPrices);
+    m_recentDepartures.clear();
+    m_recentPrices.clear();
+    m_deadEntries = 0;
+}
+
+void RouteRangeIndex::slotsDepartingBetween(const CityRouteIndex& index, qint32 fromMinutes, qint32 toMinutes,
+                                            QVector<qint32>& found) const {
+    found.clear();
+    if (fromMinutes >= toMinutes) {
+        return;
+    }
+
+    const Departure first{fromMinutes, std::numeric_limits<qint32>::min()};
+    for (const QVector<Departure> *departures : {&m_departures, &m_recentDepartures}) {
+        auto it = std::lower_bound(departures->begin(), departures->end(), first);
+        for (; it != departures->end() && it->minutes < toMinutes; ++it) {
+            if (isLive(it->slot, it->stamp)) {
+                found.append(it->slot);
+            }
+        }
+    }
+
+    // Для правил берется ближайшее отправление: окно может быть длиной в недели
+    for (qint32 slot : m_ruleSlots) {
+        const auto &rules = index.route(slot)->tripRules();
+        if (std::ranges::any_of(rules, [=](const TripRule& rule) {
+                const qint32 next = rule.nextDeparture(fromMinutes);
+                return next != Trip::INVALID_MINUTES && next < toMinutes;
+            })) {
+            found.append(slot);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+}
+
+void RouteRangeIndex::slotsInPriceRange(double minPrice, double maxPrice, QVector<qint32>& found) const {
+    found.clear();
+    const Price first{minPrice, std::numeric_limits<qint32>::min()};
+    for (const QVector<Price> *prices : {&m_prices, &m_recentPrices}) {
+        auto it = std::lower_bound(prices->begin(), prices->end(), first);
+        for (; it != prices->end() && it->price <= maxPrice; ++it) {
+            if (isLive(it->slot, it->stamp)) {
+                found.append(it->slot);
+            }
+        }
+    }
+}
@@ -1,17 +1,29 @@
 #include "schedule.h"
 #include "route.h"
 #include "trip.h"
+#include "servicecalendar.h"
 #include <ranges>
 
 Schedule::Schedule() = default;
 
-void Schedule::addTrip(std::shared_ptr<Route> route, std::shared_ptr<Trip> trip) {
-    if (route && trip) {
+void Schedule::addTrip(std::shared_ptr<Route> route, const Trip& trip) {
+    if (route) {
         m_schedule.append({route, trip});
     }
 }
 
-void Schedule::removeTrip(std::shared_ptr<Route> route, std::shared_ptr<Trip> trip) {
+void Schedule::addRouteTrips(std::shared_ptr<Route> route, const QDateTime& start, const QDateTime& end) {
+    const qint32 startMinutes = Trip::toMinutes(start);
+    const qint32 endMinutes = Trip::toMinutes(end);
+    if (!route || startMinutes == Trip::INVALID_MINUTES || endMinutes == Trip::INVALID_MINUTES) {
+        return;
+    }
+    for (const Trip& trip : route->trips(startMinutes, endMinutes)) {
+        m_schedule.append({route, trip});
+    }
+}
+
+void Schedule::removeTrip(std::shared_ptr<Route> route, const Trip& trip) {
     auto it = std::ranges::remove_if(m_schedule,
         [&route, &trip](const auto& pair) {
             return pair.first == route && pair.second == trip;
@@ -19,18 +31,23 @@ void Schedule::removeTrip(std::shared_ptr<Route> route, std::shared_ptr<Trip> tr
     m_schedule.erase(it.begin(), it.end());
 }
 
-QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> Schedule::getTripsByDate(const QDate& date) const {
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> result;
+QVector<std::pair<std::shared_ptr<Route>, Trip>> Schedule::getTripsByDate(const QDate& date) const {
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> result;
+    if (!date.isValid()) {
+        return result;
+    }
+    // Сравниваются номера суток, без построения QDateTime для каждого рейса
+    const qint32 day = ServiceCalendar::dayNumber(date);
     for (const auto& pair : m_schedule) {
-        if (pair.second && pair.second->departure().date() == date) {
+        if (ServiceCalendar::dayOfMinute(pair.second.departureMinutes()) == day) {
             result.append(pair);
         }
     }
     return result;
 }
 
-QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> Schedule::getTripsByRoute(std::shared_ptr<Route> route) const {
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> result;
+QVector<std::pair<std::shared_ptr<Route>, Trip>> Schedule::getTripsByRoute(std::shared_ptr<Route> route) const {
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> result;
     for (const auto& pair : m_schedule) {
         if (pair.first == route) {
             result.append(pair);
@@ -39,29 +56,28 @@ QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> Schedule::getT
     return result;
 }
 
-QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> Schedule::getTripsByTimeRange(
+QVector<std::pair<std::shared_ptr<Route>, Trip>> Schedule::getTripsByTimeRange(
     const QDateTime& start, const QDateTime& end) const {
-    QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> result;
+    QVector<std::pair<std::shared_ptr<Route>, Trip>> result;
+    const qint32 startMinutes = Trip::toMinutes(start);
+    const qint32 endMinutes = Trip::toMinutes(end);
     for (const auto& pair : m_schedule) {
-        if (pair.second) {
-            QDateTime departure = pair.second->departure();
-            if (departure >= start && departure <= end) {
-                result.append(pair);
-            }
+        const qint32 departure = pair.second.departureMinutes();
+        if (departure >= startMinutes && departure <= endMinutes) {
+            result.append(pair);
         }
     }
     return result;
 }
 
-QVector<std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>> Schedule::getAllTrips() const {
+QVector<std::pair<std::shared_ptr<Route>, Trip>> Schedule::getAllTrips() const {
     return m_schedule;
 }
 
 void Schedule::sortByDepartureTime() {
     std::ranges::sort(m_schedule,
         [](const auto& a, const auto& b) {
-            if (!a.second || !b.second) return false;
-            return a.second->departure() < b.second->departure();
+            return a.second.departureMinutes() < b.second.departureMinutes();
         });
 }
 
@@ -89,7 +105,7 @@ Schedule::ConstScheduleIterator Schedule::end() const {
     return m_schedule.end();
 }
 
-Schedule& Schedule::operator+=(const std::pair<std::shared_ptr<Route>, std::shared_ptr<Trip>>& item) {
+Schedule& Schedule::operator+=(const std::pair<std::shared_ptr<Route>, Trip>& item) {
     addTrip(item.first, item.second);
     return *this;
 }
@@ -98,10 +114,10 @@ Schedule& Schedule::operator+=(const std::pair<std::shared_ptr<Route>, std::shar
 QString getScheduleInfo(const Schedule& schedule) {
     QString info = QString("Schedule contains %1 trips\n").arg(schedule.m_schedule.size());
     for (const auto& [route, trip] : schedule.m_schedule) {
-        if (route && trip) {
+        if (route) {
             info += QString("Route: %1, Departure: %2\n")
                 .arg(route->name())
-                .arg(trip->departure().toString("dd.MM.yyyy HH:mm"));
+                .arg(trip.departure().toString("dd.MM.yyyy HH:mm"));
         }
     }
     return info;
@@ -0,0 +1,175 @@
+#include "servicecalendar.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr qint32 MINUTES_PER_DAY = 24 * 60;
+constexpr qint32 DAYS_PER_WORD = 64;
+constexpr qint64 UNIX_EPOCH_JULIAN_DAY = 2440588;
+
+// Деление с округлением вниз - для дней до 1970 года
+qint64 floorDiv(qint64 value, qint64 divisor) {
+    qint64 result = value / divisor;
+    if (value % divisor < 0) {
+        --result;
+    }
+    return result;
+}
+
+qint32 wordOf(qint32 day) {
+    return static_cast<qint32>(floorDiv(day, DAYS_PER_WORD));
+}
+
+quint64 bitOf(qint32 day) {
+    return quint64(1) << (day - qint64(wordOf(day)) * DAYS_PER_WORD);
+}
+
+} // namespace
+
+qint32 ServiceCalendar::dayNumber(const QDate &date) {
+    return static_cast<qint32>(date.toJulianDay() - UNIX_EPOCH_JULIAN_DAY);
+}
+
+QDate ServiceCalendar::dateOf(qint32 day) {
+    return QDate::fromJulianDay(UNIX_EPOCH_JULIAN_DAY + day);
+}
+
+qint32 ServiceCalendar::dayOfMinute(qint64 minutes) {
+    if (minutes == std::numeric_limits<qint32>::min()) {
+        return INVALID_DAY;
+    }
+    return static_cast<qint32>(floorDiv(minutes, MINUTES_PER_DAY));
+}
+
+ServiceCalendar::ServiceCalendar(qint32 firstDay, qint32 lastDay) {
+    setDays(firstDay, lastDay);
+}
+
+quint64 ServiceCalendar::word(qint32 index) const {
+    const qint64 offset = qint64(index) - m_firstWord;
+    return offset >= 0 && offset < m_words.size() ? m_words[offset] : 0;
+}
+
+void ServiceCalendar::reserveWords(qint32 firstWord, qint32 lastWord) {
+    if (m_words.isEmpty()) {
+        m_firstWord = firstWord;
+        m_words.fill(0, lastWord - firstWord + 1);
+        return;
+    }
+    if (firstWord < m_firstWord) {
+        m_words.insert(0, m_firstWord - firstWord, 0);
+        m_firstWord = firstWord;
+    }
+    if (const qint64 size = qint64(lastWord) - m_firstWord + 1; size > m_words.size()) {
+        m_words.resize(size, 0);
+    }
+}
+
+bool ServiceCalendar::runsOn(qint32 day) const {
+    return day != INVALID_DAY && (word(wordOf(day)) & bitOf(day)) != 0;
+}
+
+bool ServiceCalendar::runsOn(const QDate &date) const {
+    return date.isValid() && runsOn(dayNumber(date));
+}
+
+void ServiceCalendar::setDay(qint32 day) {
+    // Иначе карта выросла бы до дня недопустимого времени
+    if (day == INVALID_DAY) {
+        return;
+    }
+    const qint32 index = wordOf(day);
+    reserveWords(index, index);
+    m_words[index - m_firstWord] |= bitOf(day);
+}
+
+void ServiceCalendar::clearDay(qint32 day) {
+    if (day == INVALID_DAY) {
+        return;
+    }
+    const qint64 offset = qint64(wordOf(day)) - m_firstWord;
+    if (offset >= 0 && offset < m_words.size()) {
+        m_words[offset] &= ~bitOf(day);
+    }
+}
+
+void ServiceCalendar::setDays(qint32 firstDay, qint32 lastDay) {
+    if (firstDay > lastDay || firstDay == INVALID_DAY) {
+        return;
+    }
+    const qint32 firstIndex = wordOf(firstDay);
+    const qint32 lastIndex = wordOf(lastDay);
+    reserveWords(firstIndex, lastIndex);
+
+    // Внутренние слова заполняются целиком, крайние - по маске
+    for (qint32 index = firstIndex; index <= lastIndex; ++index) {
+        quint64 mask = ~quint64(0);
+        if (index == firstIndex) {
+            mask &= ~(bitOf(firstDay) - 1);
+        }
+        if (index == lastIndex) {
+            const quint64 last = bitOf(lastDay);
+            mask &= last | (last - 1);
+        }
+        m_words[index - m_firstWord] |= mask;
+    }
+}
+
+void ServiceCalendar::clear() {
+    m_words.clear();
+    m_firstWord = 0;
+}
+
+bool ServiceCalendar::isEmpty() const {
+    return std::ranges::all_of(m_words, [](quint64 bits) { return bits == 0; });
+}
+
+int ServiceCalendar::count() const {
+    int result = 0;
+    for (quint64 bits : m_words) {
+        result += std::popcount(bits);
+    }
+    return result;
+}
+
+bool ServiceCalendar::intersects(const ServiceCalendar &other) const {
+    // Перебираются только слова, присутствующие в обоих календарях
+    const qint32 first = std::max(m_firstWord, other.m_firstWord);
+    const qint64 last = std::min(qint64(m_firstWord) + m_words.size(), qint64(other.m_firstWord) + other.m_words.size());
+    for (qint64 index = first; index < last; ++index) {
+        if ((m_words[index - m_firstWord] & other.m_words[index - other.m_firstWord]) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ServiceCalendar& ServiceCalendar::operator|=(const ServiceCalendar &other) {
+    if (other.m_words.isEmpty()) {
+        return *this;
+    }
+    reserveWords(other.m_firstWord, other.m_firstWord + static_cast<qint32>(other.m_words.size()) - 1);
+    for (qsizetype i = 0; i < other.m_words.size(); ++i) {
+        m_words[other.m_firstWord - m_firstWord + i] |= other.m_words[i];
+    }
+    return *this;
+}
+
+ServiceCalendar& ServiceCalendar::operator&=(const ServiceCalendar &other) {
+    for (qsizetype i = 0; i < m_words.size(); ++i) {
+        m_words[i] &= other.word(m_firstWord + static_cast<qint32>(i));
+    }
+    return *this;
+}
+
+bool ServiceCalendar::operator==(const ServiceCalendar &other) const {
+    const qint64 first = std::min(m_firstWord, other.m_firstWord);
+    const qint64 last = std::max(qint64(m_firstWord) + m_words.size(), qint64(other.m_firstWord) + other.m_words.size());
+    for (qint64 index = first; index < last; ++index) {
+        if (word(static_cast<qint32>(index)) != other.word(static_cast<qint32>(index))) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,15 +1,183 @@
 #include "trip.h"
 #include "route.h"
 
-Trip::Trip(const QDateTime &departure) : m_departure(departure) {}
+namespace {
 
-QDateTime Trip::departure() const { return m_departure; }
+constexpr qint64 MINUTES_PER_DAY = 24 * 60;
+constexpr qint64 UNIX_EPOCH_JULIAN_DAY = 2440588;
+
+// Число дней от 1970-01-01 для даты григорианского календаря (алгоритм Х. Хиннанта)
+qint64 daysFromCivil(qint64 year, int month, int day) {
+    year -= month <= 2;
+    const qint64 era = (year >= 0 ? year : year - 399) / 400;
+    const qint64 yearOfEra = year - era * 400;
+    const qint64 dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const qint64 dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Обратное преобразование: дата по числу дней от 1970-01-01
+void civilFromDays(qint64 days, qint64 &year, int &month, int &day) {
+    days += 719468;
+    const qint64 era = (days >= 0 ? days : days - 146096) / 146097;
+    const qint64 dayOfEra = days - era * 146097;
+    const qint64 yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const qint64 dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const qint64 monthPosition = (5 * dayOfYear + 2) / 153;
+    day = static_cast<int>(dayOfYear - (153 * monthPosition + 2) / 5 + 1);
+    month = static_cast<int>(monthPosition < 10 ? monthPosition + 3 : monthPosition - 9);
+    year = yearOfEra + era * 400 + (month <= 2);
+}
+
+int daysInMonth(qint64 year, int month) {
+    static constexpr int DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : DAYS[month - 1];
+}
+
+// Читает count цифр начиная с offset; false, если встретилась не цифра
+bool readDigits(QByteArrayView text, qsizetype offset, int count, int &value) {
+    value = 0;
+    for (int i = 0; i < count; ++i) {
+        const char c = text[offset + i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+bool fitsMinutes(qint64 minutes) {
+    return minutes > Trip::INVALID_MINUTES && minutes <= std::numeric_limits<qint32>::max();
+}
+
+// Время через offset минут после отправления; у недействительного рейса и за пределами
+// диапазона минут оно недействительно
+QDateTime afterDeparture(qint32 departure, qint64 offset) {
+    if (departure == Trip::INVALID_MINUTES) {
+        return QDateTime();
+    }
+    const qint64 minutes = qint64(departure) + offset;
+    return fitsMinutes(minutes) ? Trip::toDateTime(static_cast<qint32>(minutes)) : QDateTime();
+}
+
+// Деление с округлением вниз, чтобы время до 1970 года не сдвигалось на сутки
+qint64 floorDays(qint64 minutes, qint64 &minuteOfDay) {
+    qint64 days = minutes / MINUTES_PER_DAY;
+    minuteOfDay = minutes % MINUTES_PER_DAY;
+    if (minuteOfDay < 0) {
+        minuteOfDay += MINUTES_PER_DAY;
+        --days;
+    }
+    return days;
+}
+
+} // namespace
+
+Trip::Trip(const QDateTime &departure, quint32 id) : m_id(id), m_departure(toMinutes(departure)) {}
+
+Trip Trip::fromMinutes(qint32 departureMinutes, quint32 id) {
+    Trip trip;
+    trip.m_id = id;
+    trip.m_departure = departureMinutes;
+    return trip;
+}
+
+quint32 Trip::id() const { return m_id; }
+
+void Trip::setId(quint32 id) { m_id = id; }
+
+QDateTime Trip::departure() const { return toDateTime(m_departure); }
 
 QDateTime Trip::arrival(const Route &route) const {
-    return m_departure.addSecs(route.totalDuration() * 60);
+    return afterDeparture(m_departure, route.totalDuration());
+}
+
+QDateTime Trip::arrivalAt(const Route &route, int position) const {
+    return afterDeparture(m_departure, route.arrivalOffset(position));
+}
+
+QVector<QDateTime> Trip::stopArrivals(const Route &route) const {
+    QVector<QDateTime> arrivals;
+    arrivals.reserve(route.totalStops());
+    for (int offset : route.arrivalOffsets()) {
+        arrivals.append(afterDeparture(m_departure, offset));
+    }
+    return arrivals;
+}
+
+qint32 Trip::toMinutes(const QDateTime &dateTime) {
+    if (!dateTime.isValid()) {
+        return INVALID_MINUTES;
+    }
+    const qint64 minutes = (dateTime.date().toJulianDay() - UNIX_EPOCH_JULIAN_DAY) * MINUTES_PER_DAY
+                           + dateTime.time().hour() * 60 + dateTime.time().minute();
+    return fitsMinutes(minutes) ? static_cast<qint32>(minutes) : INVALID_MINUTES;
+}
+
+QDateTime Trip::toDateTime(qint32 minutes) {
+    if (minutes == INVALID_MINUTES) {
+        return QDateTime();
+    }
+    qint64 minuteOfDay = 0;
+    const qint64 days = floorDays(minutes, minuteOfDay);
+    return QDateTime(QDate::fromJulianDay(UNIX_EPOCH_JULIAN_DAY + days),
+                     QTime(static_cast<int>(minuteOfDay / 60), static_cast<int>(minuteOfDay % 60)));
+}
+
+bool Trip::parseIsoMinutes(QByteArrayView text, qint32 &minutes) {
+    // Позиции разделителей фиксированы: yyyy-MM-ddTHH:mm[:ss]
+    if ((text.size() != 16 && text.size() != 19)
+        || text[4] != '-' || text[7] != '-' || text[10] != 'T' || text[13] != ':'
+        || (text.size() == 19 && text[16] != ':')) {
+        return false;
+    }
+
+    int year, month, day, hour, minute, second = 0;
+    if (!readDigits(text, 0, 4, year) || !readDigits(text, 5, 2, month) || !readDigits(text, 8, 2, day)
+        || !readDigits(text, 11, 2, hour) || !readDigits(text, 14, 2, minute)
+        || (text.size() == 19 && !readDigits(text, 17, 2, second))) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month)
+        || hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+
+    const qint64 value = daysFromCivil(year, month, day) * MINUTES_PER_DAY + hour * 60 + minute;
+    if (!fitsMinutes(value)) {
+        return false;
+    }
+    minutes = static_cast<qint32>(value);
+    return true;
 }
 
+QByteArray Trip::formatIsoMinutes(qint32 minutes) {
+    qint64 minuteOfDay = 0;
+    qint64 year = 0;
+    int month = 0;
+    int day = 0;
+    civilFromDays(floorDays(minutes, minuteOfDay), year, month, day);
+    if (minutes == INVALID_MINUTES || year < 0 || year > 9999) {
+        return toDateTime(minutes).toString("yyyy-MM-ddTHH:mm").toUtf8();
+    }
 
-auto Trip::operator<=>(const Trip& other) const {
-    return m_departure <=> other.m_departure;
+    QByteArray text(16, '\0');
+    const auto put = [&text](qsizetype offset, int count, qint64 value) {
+        for (qsizetype i = offset + count - 1; i >= offset; --i) {
+            text[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    };
+    put(0, 4, year);
+    text[4] = '-';
+    put(5, 2, month);
+    text[7] = '-';
+    put(8, 2, day);
+    text[10] = 'T';
+    put(11, 2, minuteOfDay / 60);
+    text[13] = ':';
+    put(14, 2, minuteOfDay % 60);
+    return text;
 }
@@ -0,0 +1,229 @@
+#include "triprule.h"
+#include "servicecalendar.h"
+#include "trip.h"
+#include <QStringList>
+#include <algorithm>
+
+namespace {
+
+constexpr qint32 MINUTES_PER_DAY = 24 * 60;
+
+template<typename T>
+void sortUnique(QVector<T> &values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+QList<QByteArrayView> splitList(QByteArrayView text, char separator) {
+    QList<QByteArrayView> parts;
+    qsizetype start = 0;
+    for (qsizetype i = 0; i <= text.size(); ++i) {
+        if (i == text.size() || text[i] == separator) {
+            parts.append(text.sliced(start, i - start).trimmed());
+            start = i + 1;
+        }
+    }
+    return parts;
+}
+
+} // namespace
+
+TripRule::TripRule(const QDate &firstDay, const QDate &lastDay, const QVector<QTime> &times,
+                   const QVector<QDate> &exceptDays) {
+    if (firstDay.isValid() && lastDay.isValid()) {
+        m_firstDay = ServiceCalendar::dayNumber(firstDay);
+        m_lastDay = ServiceCalendar::dayNumber(lastDay);
+    }
+    for (const QTime &time : times) {
+        if (time.isValid()) {
+            m_times.append(static_cast<qint16>(time.hour() * 60 + time.minute()));
+        }
+    }
+    for (const QDate &date : exceptDays) {
+        if (date.isValid()) {
+            m_exceptDays.append(ServiceCalendar::dayNumber(date));
+        }
+    }
+    sortUnique(m_times);
+    sortUnique(m_exceptDays);
+
+    // Дни работы правила собираются в битовую карту один раз
+    m_calendar.setDays(m_firstDay, m_lastDay);
+    for (qint32 day : m_exceptDays) {
+        m_calendar.clearDay(day);
+    }
+}
+
+QDate TripRule::firstDay() const { return ServiceCalendar::dateOf(m_firstDay); }
+
+QDate TripRule::lastDay() const { return ServiceCalendar::dateOf(m_lastDay); }
+
+QVector<QTime> TripRule::times() const {
+    QVector<QTime> result;
+    result.reserve(m_times.size());
+    for (qint16 minute : m_times) {
+        result.append(QTime(minute / 60, minute % 60));
+    }
+    return result;
+}
+
+QVector<QDate> TripRule::exceptDays() const {
+    QVector<QDate> result;
+    result.reserve(m_exceptDays.size());
+    for (qint32 day : m_exceptDays) {
+        result.append(ServiceCalendar::dateOf(day));
+    }
+    return result;
+}
+
+bool TripRule::isValid() const {
+    return m_firstDay <= m_lastDay && !m_times.isEmpty();
+}
+
+bool TripRule::runsOn(const QDate &date) const {
+    return isValid() && m_calendar.runsOn(date);
+}
+
+void TripRule::expand(qint32 fromMinutes, qint32 toMinutes, QVector<qint32> &departures) const {
+    if (!isValid() || fromMinutes >= toMinutes) {
+        return;
+    }
+
+    // Перебираются только сутки, пересекающиеся с окном
+    const qint32 firstDay = std::max(m_firstDay, ServiceCalendar::dayOfMinute(fromMinutes));
+    const qint32 lastDay = std::min(m_lastDay, ServiceCalendar::dayOfMinute(qint64(toMinutes) - 1));
+    for (qint32 day = firstDay; day <= lastDay; ++day) {
+        if (!m_calendar.runsOn(day)) {
+            continue;
+        }
+        const qint64 dayStart = qint64(day) * MINUTES_PER_DAY;
+        for (qint16 minute : m_times) {
+            const qint64 departure = dayStart + minute;
+            if (departure >= fromMinutes && departure < toMinutes) {
+                departures.append(static_cast<qint32>(departure));
+            }
+        }
+    }
+}
+
+bool TripRule::hasDeparturesBetween(qint32 fromMinutes, qint32 toMinutes) const {
+    if (!isValid() || fromMinutes >= toMinutes) {
+        return false;
+    }
+
+    // Те же сутки, что и в expand, но до первого подходящего отправления
+    const qint32 firstDay = std::max(m_firstDay, ServiceCalendar::dayOfMinute(fromMinutes));
+    const qint32 lastDay = std::min(m_lastDay, ServiceCalendar::dayOfMinute(qint64(toMinutes) - 1));
+    for (qint32 day = firstDay; day <= lastDay; ++day) {
+        if (!m_calendar.runsOn(day)) {
+            continue;
+        }
+        const qint64 dayStart = qint64(day) * MINUTES_PER_DAY;
+        const auto it = std::lower_bound(m_times.begin(), m_times.end(), std::max<qint64>(fromMinutes - dayStart, 0));
+        if (it != m_times.end() && dayStart + *it < toMinutes) {
+            return true;
+        }
+    }
+    return false;
+}
+
+qint32 TripRule::nextDeparture(qint32 fromMinutes) const {
+    if (!isValid()) {
+        return Trip::INVALID_MINUTES;
+    }
+
+    // Дни без рейсов пропускаются по календарю; в первый день подходят только более поздние времена
+    for (qint32 day = std::max(m_firstDay, ServiceCalendar::dayOfMinute(fromMinutes)); day <= m_lastDay; ++day) {
+        if (!m_calendar.runsOn(day)) {
+            continue;
+        }
+        const qint64 dayStart = qint64(day) * MINUTES_PER_DAY;
+        const qint64 minute = std::max<qint64>(fromMinutes - dayStart, 0);
+        const auto it = std::lower_bound(m_times.begin(), m_times.end(), minute);
+        if (it != m_times.end()) {
+            return static_cast<qint32>(dayStart + *it);
+        }
+    }
+    return Trip::INVALID_MINUTES;
+}
+
+qint32 TripRule::firstDeparture() const {
+    return isValid() ? static_cast<qint32>(qint64(m_firstDay) * MINUTES_PER_DAY + m_times.first()) : 0;
+}
+
+qint32 TripRule::lastDeparture() const {
+    return isValid() ? static_cast<qint32>(qint64(m_lastDay) * MINUTES_PER_DAY + m_times.last()) : -1;
+}
+
+bool TripRule::parse(QByteArrayView text, TripRule &rule) {
+    const auto fields = splitList(text, ';');
+    if (fields.size() != 3 && fields.size() != 4) {
+        return false;
+    }
+
+    const QDate firstDay = QDate::fromString(QString::fromLatin1(fields[0]), Qt::ISODate);
+    const QDate lastDay = QDate::fromString(QString::fromLatin1(fields[1]), Qt::ISODate);
+    if (!firstDay.isValid() || !lastDay.isValid()) {
+        return false;
+    }
+
+    QVector<QTime> times;
+    for (QByteArrayView field : splitList(fields[2], ',')) {
+        const QTime time = QTime::fromString(QString::fromLatin1(field), "HH:mm");
+        if (!time.isValid()) {
+            return false;
+        }
+        times.append(time);
+    }
+
+    QVector<QDate> exceptDays;
+    if (fields.size() == 4 && !fields[3].isEmpty()) {
+        for (QByteArrayView field : splitList(fields[3], ',')) {
+            const QDate date = QDate::fromString(QString::fromLatin1(field), Qt::ISODate);
+            if (!date.isValid()) {
+                return false;
+            }
+            exceptDays.append(date);
+        }
+    }
+
+    rule = TripRule(firstDay, lastDay, times, exceptDays);
+    return rule.isValid();
+}
+
+QByteArray TripRule::format() const {
+    QStringList times;
+    for (const QTime &time : this->times()) {
+        times.append(time.toString("HH:mm"));
+    }
+    QStringList exceptions;
+    for (const QDate &date : exceptDays()) {
+        exceptions.append(date.toString(Qt::ISODate));
+    }
+
+    QString text = firstDay().toString(Qt::ISODate) + ';' + lastDay().toString(Qt::ISODate) + ';' + times.join(',');
+    if (!exceptions.isEmpty()) {
+        text += ";" + exceptions.join(',');
+    }
+    return text.toLatin1();
+}
+
+QString TripRule::description() const {
+    QStringList times;
+    for (const QTime &time : this->times()) {
+        times.append(time.toString("HH:mm"));
+    }
+
+    QString text = QString("%1 ежедневно с %2 по %3")
+                       .arg(times.join(", "))
+                       .arg(firstDay().toString("dd.MM.yyyy"))
+                       .arg(lastDay().toString("dd.MM.yyyy"));
+    if (!m_exceptDays.isEmpty()) {
+        QStringList exceptions;
+        for (const QDate &date : exceptDays()) {
+            exceptions.append(date.toString("dd.MM.yyyy"));
+        }
+        text += ", кроме " + exceptions.join(", ");
+    }
+    return text;
+}
@@ -0,0 +1,104 @@
+#include "tripruledialog.h"
+#include <QFormLayout>
+#include <QDateEdit>
+#include <QLineEdit>
+#include <QDialogButtonBox>
+#include <QMessageBox>
+#include <QStringList>
+
+TripRuleDialog::TripRuleDialog(QWidget *parent)
+    : QDialog(parent){
+    deFirstDay = new QDateEdit(QDate::currentDate(), this);
+    deFirstDay->setDisplayFormat("dd.MM.yyyy");
+    deFirstDay->setCalendarPopup(true);
+
+    deLastDay = new QDateEdit(QDate::currentDate().addMonths(1), this);
+    deLastDay->setDisplayFormat("dd.MM.yyyy");
+    deLastDay->setCalendarPopup(true);
+
+    leTimes = new QLineEdit(this);
+    leTimes->setPlaceholderText("06:00, 14:00");
+
+    leExceptions = new QLineEdit(this);
+    leExceptions->setPlaceholderText("31.12.2024, 01.01.2025");
+
+    auto *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttons, &QDialogButtonBox::accepted, this, &TripRuleDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &TripRuleDialog::reject);
+
+    auto *layout = new QFormLayout(this);
+    layout->addRow("Первый день:", deFirstDay);
+    layout->addRow("Последний день:", deLastDay);
+    layout->addRow("Время отправления:", leTimes);
+    layout->addRow("Кроме дней:", leExceptions);
+    layout->addWidget(buttons);
+
+    setWindowTitle("Правило расписания");
+}
+
+void TripRuleDialog::setRule(const TripRule &rule){
+    deFirstDay->setDate(rule.firstDay());
+    deLastDay->setDate(rule.lastDay());
+
+    QStringList times;
+    for(const QTime &time : rule.times()){
+        times.append(time.toString("HH:mm"));
+    }
+    leTimes->setText(times.join(", "));
+
+    QStringList exceptions;
+    for(const QDate &date : rule.exceptDays()){
+        exceptions.append(date.toString("dd.MM.yyyy"));
+    }
+    leExceptions->setText(exceptions.join(", "));
+}
+
+TripRule TripRuleDialog::rule() const{
+    TripRule result;
+    QString error;
+    readInput(result, error);
+    return result;
+}
+
+void TripRuleDialog::accept(){
+    TripRule result;
+    if(QString error; !readInput(result, error)){
+        QMessageBox::warning(this, "Ошибка", error);
+        return;
+    }
+    QDialog::accept();
+}
+
+bool TripRuleDialog::readInput(TripRule &rule, QString &error) const{
+    QVector<QTime> times;
+    for(const QString &part : leTimes->text().split(',', Qt::SkipEmptyParts)){
+        const QTime time = QTime::fromString(part.trimmed(), "HH:mm");
+        if(!time.isValid()){
+            error = QString("Неверное время отправления: %1").arg(part.trimmed());
+            return false;
+        }
+        times.append(time);
+    }
+    if(times.isEmpty()){
+        error = "Укажите хотя бы одно время отправления";
+        return false;
+    }
+
+    QVector<QDate> exceptions;
+    for(const QString &part : leExceptions->text().split(',', Qt::SkipEmptyParts)){
+        const QDate date = QDate::fromString(part.trimmed(), "dd.MM.yyyy");
+        if(!date.isValid()){
+            error = QString("Неверная дата исключения: %1").arg(part.trimmed());
+            return false;
+        }
+        exceptions.append(date);
+    }
+
+    if(deFirstDay->date() > deLastDay->date()){
+        error = "Последний день не может быть раньше первого";
+        return false;
+    }
+
+    rule = TripRule(deFirstDay->date(), deLastDay->date(), times, exceptions);
+    return rule.isValid();
+}